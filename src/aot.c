@@ -0,0 +1,448 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Ahead of time translation of whole roms into C. aot_generate() walks each
+ * rom from the entry point and the rst and interrupt vectors, following
+ * jumps, calls and branches, and writes one C function per block it finds.
+ * A function does what block_exec() does for the same block, only with the
+ * handler calls and operands spelled out, so the compiler sees straight line
+ * code with direct calls.
+ *
+ * Blocks in 4000-7FFF are keyed by rom bank like the block cache. The walk
+ * keeps track of the bank the code would run with, starting from bank 1, and
+ * follows stores of a known value to the MBC1 bank register. Jumps whose
+ * target or bank can not be worked out are simply not followed.
+ *
+ * Built with the output (make aot), cart_load() picks the translation whose
+ * image hash matches and block.c runs its functions in place of the
+ * predecoded ops. Anything without a translation, RAM code included, is
+ * interpreted as usual.
+ */
+
+#include "block.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef AOT
+/* aot_roms.c, written by aot_generate() */
+extern const struct aot_rom aot_roms[];
+extern const unsigned aot_nroms;
+#else
+static const struct aot_rom *const aot_roms = NULL;
+static const unsigned aot_nroms = 0;
+#endif
+
+/* FNV-1a over the whole image */
+static uint32_t aot_hash(const uint8_t *rom, uint32_t size) {
+	uint32_t h = 2166136261u;
+	for(uint32_t i = 0; i < size; ++i) {
+		h = (h ^ rom[i]) * 16777619u;
+	}
+	return h;
+}
+
+/* Picks the translation of the loaded rom, if there is one built in. */
+void aot_attach(struct gb *gb) {
+	uint32_t hash;
+	gb->aot = NULL;
+	if(!aot_nroms || gb->rom == NULL) {
+		return;
+	}
+	hash = aot_hash(gb->rom, gb->rom_size);
+	for(unsigned i = 0; i < aot_nroms; ++i) {
+		if(aot_roms[i].hash == hash && aot_roms[i].size == gb->rom_size) {
+			gb->aot = &aot_roms[i];
+			return;
+		}
+	}
+}
+
+/* The translated block for a block cache key, NULL if there is none. */
+instruction_f aot_find(struct gb *gb, uint32_t key) {
+	const struct aot_block *blocks = gb->aot->blocks;
+	unsigned lo = 0, hi = gb->aot->count;
+	while(lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		if(blocks[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < gb->aot->count && blocks[lo].key == key ? blocks[lo].fn : NULL;
+}
+
+/* ************************************************************** */
+/* GENERATOR */
+
+/* bank 0 never shows up at 4000-7FFF, so the walk uses it for unknown */
+#define AOT_BANK_UNKNOWN	0
+/* longest straight run in one function, longer ones go on in the next */
+#define AOT_BLOCK_OPS	64
+
+struct aot_walk {
+	const uint8_t *rom;
+	uint32_t size;
+	int mbc; /* has a bank register at 2000-3FFF */
+	/* (bank << 16 | pc) already walked, for 0000-3FFF the bank is the one
+	 * the code was reached with, it decides where its jumps go */
+	uint8_t *seen;
+	uint32_t *todo;
+	unsigned ntodo, todo_cap;
+	/* blocks to emit, as block cache keys */
+	uint32_t *keys;
+	unsigned nkeys, keys_cap;
+	uint8_t *emitted;
+	int failed; /* out of memory */
+};
+
+/* Operand and opcode bytes at pc with the given bank mapped, 0 past the
+ * end of the image. */
+static int aot_byte(const struct aot_walk *w, unsigned bank, uint16_t pc, uint8_t *out) {
+	uint32_t a = pc < 0x4000 ? pc : bank * 0x4000u + pc - 0x4000;
+	if(a >= w->size) {
+		return 0;
+	}
+	*out = w->rom[a];
+	return 1;
+}
+
+/* Appends v to list, sets w->failed if there is no memory for it. */
+static void aot_push(struct aot_walk *w, uint32_t **list, unsigned *n, unsigned *cap, uint32_t v) {
+	if(*n == *cap) {
+		unsigned grown = *cap ? *cap * 2 : 1024;
+		uint32_t *p = realloc(*list, grown * sizeof(uint32_t));
+		if(p == NULL) {
+			w->failed = 1;
+			return;
+		}
+		*list = p;
+		*cap = grown;
+	}
+	(*list)[(*n)++] = v;
+}
+
+/* Queues the block at pc, reached with bank mapped. */
+static void aot_visit(struct aot_walk *w, unsigned bank, uint16_t pc) {
+	uint32_t v = (uint32_t)bank << 16 | pc;
+	if(pc >= 0x8000 || (pc >= 0x4000 && bank == AOT_BANK_UNKNOWN)) {
+		return;
+	}
+	if(w->seen[v >> 3] & (1 << (v & 7))) {
+		return;
+	}
+	w->seen[v >> 3] |= 1 << (v & 7);
+	aot_push(w, &w->todo, &w->ntodo, &w->todo_cap, v);
+}
+
+/* Writes A, for following the value stored to the bank register. */
+static int aot_writes_a(uint8_t op, uint8_t cb) {
+	if(op == 0xCB) {
+		return (cb & 7) == 7 && (cb < 0x40 || cb >= 0x80);
+	}
+	switch(op) {
+		case 0x07: case 0x0A: case 0x0F: case 0x17: case 0x1A: case 0x1F:
+		case 0x27: case 0x2A: case 0x2F: case 0x3A: case 0x3C: case 0x3D: case 0x3E:
+		case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6:
+		case 0xF0: case 0xF1: case 0xF2: case 0xFA:
+			return 1;
+	}
+	return (op >= 0x78 && op < 0x80) || (op >= 0x80 && op < 0xB8);
+}
+
+/* Writes H or L. */
+static int aot_writes_hl(uint8_t op, uint8_t cb) {
+	if(op == 0xCB) {
+		return ((cb & 7) == 4 || (cb & 7) == 5) && (cb < 0x40 || cb >= 0x80);
+	}
+	switch(op) {
+		case 0x09: case 0x19: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25:
+		case 0x26: case 0x29: case 0x2A: case 0x2B: case 0x2C: case 0x2D: case 0x2E:
+		case 0x32: case 0x39: case 0x3A: case 0xE1: case 0xF8:
+			return 1;
+	}
+	return op >= 0x60 && op < 0x70;
+}
+
+/* Walks one block and queues where it can go next. Blocks end like in
+ * block_build(), only the op limit is higher. */
+static void aot_walk_block(struct aot_walk *w, uint32_t v) {
+	unsigned bank = v >> 16;
+	uint16_t pc = (uint16_t)v;
+	uint16_t end = pc < 0x4000 ? 0x4000 : 0x8000;
+	int a_known = 0, hl_known = 0;
+	uint8_t a = 0;
+	uint16_t hl = 0;
+	uint32_t key = pc < 0x4000 ? pc : v;
+	unsigned count = 0;
+
+	if(pc >= 0x4000 || !(w->emitted[pc >> 3] & (1 << (pc & 7)))) {
+		uint8_t b;
+		if(!aot_byte(w, bank, pc, &b)) {
+			return;
+		}
+		/* block_build() never caches an instruction that runs into the next
+		 * region, it still gets walked for where it goes */
+		if(pc + instr_length[b] <= end) {
+			if(pc < 0x4000) {
+				w->emitted[pc >> 3] |= 1 << (pc & 7);
+			}
+			aot_push(w, &w->keys, &w->nkeys, &w->keys_cap, key);
+		}
+	}
+	while(pc < end) {
+		uint8_t op, b1 = 0, b2 = 0;
+		uint8_t len;
+		uint16_t imm, next;
+		int store = -1; /* address of a bank register store, or -1 */
+		int value = -1;
+
+		if(!aot_byte(w, bank, pc, &op)) {
+			return;
+		}
+		len = instr_length[op];
+		if((len > 1 && !aot_byte(w, bank, pc + 1, &b1)) || (len > 2 && !aot_byte(w, bank, pc + 2, &b2))) {
+			return;
+		}
+		imm = len == 3 ? b1 | b2 << 8 : b1;
+		next = pc + len;
+
+		switch(op) {
+			case 0xEA: /* LD (nn),A */
+				store = imm;
+				value = a_known ? a : -1;
+				break;
+			case 0x77: /* LD (HL),A */
+				store = hl_known ? hl : -1;
+				value = a_known ? a : -1;
+				break;
+			case 0x36: /* LD (HL),n */
+				store = hl_known ? hl : -1;
+				value = imm;
+				break;
+		}
+		if(w->mbc && store >= 0x2000 && store < 0x4000) {
+			bank = value < 0 ? AOT_BANK_UNKNOWN : value ? value : 1;
+		}
+		if(op == 0xAF) { /* XOR A */
+			a_known = 1;
+			a = 0;
+		} else if(aot_writes_a(op, b1)) {
+			a_known = op == 0x3E;
+			a = (uint8_t)imm;
+		}
+		if(aot_writes_hl(op, b1)) {
+			hl_known = op == 0x21;
+			hl = imm;
+		}
+
+		switch(op) {
+			case 0x18: /* JR */
+				aot_visit(w, bank, next + (int8_t)imm);
+				return;
+			case 0x20: case 0x28: case 0x30: case 0x38:
+				aot_visit(w, bank, next + (int8_t)imm);
+				aot_visit(w, bank, next);
+				return;
+			case 0xC3: /* JP */
+				aot_visit(w, bank, imm);
+				return;
+			case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+			case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: /* CALL */
+				aot_visit(w, bank, imm);
+				aot_visit(w, bank, next);
+				return;
+			case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: /* RST */
+				aot_visit(w, bank, op & 0x38);
+				aot_visit(w, bank, next);
+				return;
+			case 0xC0: case 0xC8: case 0xD0: case 0xD8: /* RET cc */
+			case 0x10: case 0x76: case 0xF3: case 0xFB: /* STOP HALT DI EI */
+				aot_visit(w, bank, next);
+				return;
+			case 0xC9: case 0xD9: case 0xE9: /* RET RETI JP (HL) */
+				return;
+		}
+		/* a new block starts after one that runs into the next region */
+		if(++count == AOT_BLOCK_OPS || pc + len > end) {
+			aot_visit(w, bank, next);
+			return;
+		}
+		pc = next;
+	}
+	aot_visit(w, bank, pc);
+}
+
+static int aot_key_cmp(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Writes the function for the block at key, split like aot_walk_block(). */
+static void aot_emit_block(FILE *out, const struct aot_walk *w, unsigned n, uint32_t key) {
+	unsigned bank = key >> 16;
+	uint16_t pc = (uint16_t)key;
+	uint16_t end = pc < 0x4000 ? 0x4000 : 0x8000;
+	unsigned count = 0;
+
+	fprintf(out, "static void r%u_%06x(struct gb *gb) {\n", n, key);
+	while(pc < end && count < AOT_BLOCK_OPS) {
+		uint8_t op, b1 = 0, b2 = 0;
+		uint8_t len, cycles;
+
+		if(!aot_byte(w, bank, pc, &op)) {
+			break;
+		}
+		len = instr_length[op];
+		/* the operands have to come from the same region, see block_build() */
+		if(pc + len > end) {
+			break;
+		}
+		if((len > 1 && !aot_byte(w, bank, pc + 1, &b1)) || (len > 2 && !aot_byte(w, bank, pc + 2, &b2))) {
+			break;
+		}
+		if(count) {
+			fputs("\tif(gb->cycle_counter >= gb->until) return;\n", out);
+		}
+		if(op == 0xCB) {
+			cycles = instr_cb_timing[b1];
+			fprintf(out, "\tgb->r.PC += 2; %s(gb);", instr_cb_names[b1]);
+		} else {
+			cycles = instr_timing[op];
+			fputs("\tgb->r.PC += 1; ", out);
+			if(len > 1) {
+				fprintf(out, "gb->imm = 0x%04x; ", len == 3 ? b1 | b2 << 8 : b1);
+			}
+			fprintf(out, "%s(gb);", instr_names[op]);
+		}
+		if(cycles) {
+			fprintf(out, " gb->cycle_counter += %u;", cycles << 2);
+		}
+		fprintf(out, " ++gb->instr_counter; /* %04x */\n", pc);
+		++count;
+		pc += len;
+		if(block_ends(op)) {
+			break;
+		}
+	}
+	fputs("}\n\n", out);
+}
+
+/*
+ * Translates every rom in roms into one C file at path, for building into
+ * the emulator with -DAOT. Returns 0 on success.
+ */
+int aot_generate(const char *path, const char *const *roms, unsigned nroms) {
+	FILE *out = fopen(path, "w");
+	struct aot_rom *info;
+	unsigned total = 0;
+	int ret = 0;
+
+	if(out == NULL) {
+		perror(path);
+		return -1;
+	}
+	info = calloc(nroms, sizeof(struct aot_rom));
+	if(info == NULL) {
+		fprintf(stderr, "%s: out of memory\n", path);
+		fclose(out);
+		remove(path);
+		return -1;
+	}
+	fputs("/* Written by failboy --aot, see aot.c. Do not edit. */\n\n"
+		"#include \"block.h\"\n#include \"cpu_instr_cb.h\"\n\n", out);
+	for(unsigned n = 0; n < nroms && !ret; ++n) {
+		struct gb *gb = gb_alloc();
+		struct aot_walk w;
+
+		if(cart_load(gb, roms[n])) {
+			fprintf(stderr, "%s: could not load rom\n", roms[n]);
+			gb_free(gb);
+			ret = -1;
+			break;
+		}
+		memset(&w, 0, sizeof(w));
+		w.rom = gb->rom;
+		w.size = gb->rom_size;
+		w.mbc = gb->rom[0x147] >= 1 && gb->rom[0x147] <= 3;
+		w.seen = calloc(1, (256 << 16) >> 3);
+		w.emitted = calloc(1, 0x4000 >> 3);
+		if(w.seen == NULL || w.emitted == NULL) {
+			fprintf(stderr, "%s: out of memory\n", roms[n]);
+			free(w.seen);
+			free(w.emitted);
+			gb_free(gb);
+			ret = -1;
+			break;
+		}
+
+		aot_visit(&w, 1, 0x100);
+		for(unsigned v = 0; v <= 0x60; v += 8) {
+			aot_visit(&w, 1, v);
+		}
+		while(w.ntodo && !w.failed) {
+			aot_walk_block(&w, w.todo[--w.ntodo]);
+		}
+		if(w.failed) {
+			fprintf(stderr, "%s: out of memory\n", roms[n]);
+			free(w.seen);
+			free(w.emitted);
+			free(w.todo);
+			free(w.keys);
+			gb_free(gb);
+			ret = -1;
+			break;
+		}
+		qsort(w.keys, w.nkeys, sizeof(uint32_t), aot_key_cmp);
+
+		fprintf(out, "/* %s */\n\n", roms[n]);
+		for(unsigned i = 0; i < w.nkeys; ++i) {
+			aot_emit_block(out, &w, n, w.keys[i]);
+		}
+		fprintf(out, "static const struct aot_block r%u_blocks[] = {\n", n);
+		for(unsigned i = 0; i < w.nkeys; ++i) {
+			fprintf(out, "\t{ 0x%06x, r%u_%06x },\n", w.keys[i], n, w.keys[i]);
+		}
+		fputs("};\n\n", out);
+		fprintf(stderr, "%s: %u blocks\n", roms[n], w.nkeys);
+		info[n].hash = aot_hash(gb->rom, gb->rom_size);
+		info[n].size = gb->rom_size;
+		info[n].count = w.nkeys;
+		total += w.nkeys;
+
+		free(w.seen);
+		free(w.emitted);
+		free(w.todo);
+		free(w.keys);
+		gb_free(gb);
+	}
+	if(!ret) {
+		fputs("const struct aot_rom aot_roms[] = {\n", out);
+		for(unsigned n = 0; n < nroms; ++n) {
+			fprintf(out, "\t{ 0x%08x, 0x%x, %u, r%u_blocks }, /* %s */\n",
+				info[n].hash, info[n].size, info[n].count, n, roms[n]);
+		}
+		fprintf(out, "};\n\nconst unsigned aot_nroms = %u;\n", nroms);
+	}
+	free(info);
+	fclose(out);
+	if(ret) {
+		remove(path);
+	} else {
+		fprintf(stderr, "%s: %u blocks from %u roms\n", path, total, nroms);
+	}
+	return ret;
+}
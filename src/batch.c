@@ -0,0 +1,303 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Batch mode, runs a manifest of ROMs on a pool of worker threads and writes
+ * one JSON line per job. A job ends early when the rom reports a test result,
+ * see serial_stop_tests().
+ *
+ * Manifest lines are "cycles N path" or "frames N path", blank lines and lines
+ * starting with # are skipped.
+ */
+
+#include "failboy.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct job {
+	char *rom;
+	uint64_t budget;
+	int frames;
+};
+
+/*
+ * Each worker owns a deque of job indices. It takes work from the front of its
+ * own deque and steals from the back of the others once it runs dry. Jobs are
+ * whole ROM runs, so a lock per deque costs nothing worth measuring.
+ */
+struct deque {
+	pthread_mutex_t lock;
+	unsigned *jobs;
+	unsigned head;
+	unsigned tail;
+};
+
+struct batch {
+	struct job *jobs;
+	unsigned njobs;
+	struct deque *queues;
+	unsigned nqueues;
+	FILE *out;
+	pthread_mutex_t out_lock;
+	int jit;
+};
+
+struct worker {
+	struct batch *batch;
+	unsigned id;
+	pthread_t thread;
+};
+
+static const char *stop_names[] = {
+	[STOP_NONE] = "budget",
+	[STOP_PASSED] = "passed",
+	[STOP_FAILED] = "failed"
+};
+
+void json_string(FILE *out, const char *s, size_t len) {
+	fputc('"', out);
+	for(size_t i = 0; i < len; ++i) {
+		unsigned char c = s[i];
+		if(c == '"' || c == '\\') {
+			fputc('\\', out);
+			fputc(c, out);
+		} else if(c == '\n') {
+			fputs("\\n", out);
+		} else if(c < 0x20 || c >= 0x7F) {
+			fprintf(out, "\\u%04x", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void batch_job(struct batch *b, unsigned index) {
+	struct job *job = &b->jobs[index];
+	char serial[SERIAL_BUF_SIZE];
+	unsigned serial_len = 0;
+	uint32_t serial_pos = 0;
+	const char *reason = "error";
+	uint64_t cycles = 0;
+	uint64_t start = clock_ns();
+	struct gb *gb = gb_alloc();
+	
+	if(!cart_load(gb, job->rom)) {
+		if(b->jit) {
+			jit_enable(gb);
+		}
+		serial_stop_tests(gb);
+		cpu_bios_init(gb);
+		if(job->frames) {
+			for(uint64_t i = 0; i < job->budget && !gb->stop_reason; ++i) {
+				cycles += run_frame(gb);
+			}
+		} else {
+			cycles = run_cycles(gb, job->budget);
+		}
+		reason = stop_names[gb->stop_reason];
+		serial_len = serial_read(gb, &serial_pos, serial, sizeof(serial));
+	}
+	gb_free(gb);
+	
+	uint64_t wall = clock_ns() - start;
+	
+	pthread_mutex_lock(&b->out_lock);
+	fprintf(b->out, "{\"job\":%u,\"rom\":", index);
+	json_string(b->out, job->rom, strlen(job->rom));
+	fprintf(b->out, ",\"exit\":\"%s\",\"cycles\":%llu,\"wall_ns\":%llu,\"serial\":",
+		reason, (unsigned long long)cycles, (unsigned long long)wall);
+	json_string(b->out, serial, serial_len);
+	fputs("}\n", b->out);
+	fflush(b->out);
+	pthread_mutex_unlock(&b->out_lock);
+}
+
+static int batch_take(struct batch *b, unsigned id, unsigned *index) {
+	struct deque *q = &b->queues[id];
+	int found = 0;
+	
+	pthread_mutex_lock(&q->lock);
+	if(q->head < q->tail) {
+		*index = q->jobs[q->head++];
+		found = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	
+	/* steal from the back of someone else */
+	for(unsigned i = 1; !found && i < b->nqueues; ++i) {
+		q = &b->queues[(id + i) % b->nqueues];
+		pthread_mutex_lock(&q->lock);
+		if(q->head < q->tail) {
+			*index = q->jobs[--q->tail];
+			found = 1;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	return found;
+}
+
+static void *batch_worker(void *arg) {
+	struct worker *w = arg;
+	unsigned index;
+	/* nothing is ever queued after start, so empty everywhere means done */
+	while(batch_take(w->batch, w->id, &index)) {
+		batch_job(w->batch, index);
+	}
+	return NULL;
+}
+
+static void batch_free_jobs(struct job *jobs, unsigned count) {
+	for(unsigned i = 0; i < count; ++i) {
+		free(jobs[i].rom);
+	}
+	free(jobs);
+}
+
+/* Reads the jobs in manifest into jobs and count, skipping lines it can not
+ * make sense of. Returns -1 if it can not be read or there is no memory. */
+static int batch_parse(const char *manifest, struct job **jobs, unsigned *count) {
+	FILE *f = fopen(manifest, "r");
+	char line[4096];
+	unsigned cap = 0;
+	unsigned lineno = 0;
+	int nomem = 0;
+	
+	*jobs = NULL;
+	*count = 0;
+	if(f == NULL) {
+		perror(manifest);
+		return -1;
+	}
+	while(fgets(line, sizeof(line), f)) {
+		char kind[16];
+		unsigned long long budget;
+		int offset;
+		struct job *job;
+		++lineno;
+		line[strcspn(line, "\r\n")] = 0;
+		if(line[0] == 0 || line[0] == '#') {
+			continue;
+		}
+		if(sscanf(line, "%15s %llu %n", kind, &budget, &offset) != 2 || line[offset] == 0
+			|| (strcmp(kind, "cycles") && strcmp(kind, "frames"))) {
+			fprintf(stderr, "%s:%u: expected \"cycles N rom\" or \"frames N rom\"\n", manifest, lineno);
+			continue;
+		}
+		if(*count == cap) {
+			unsigned grown = cap ? cap * 2 : 64;
+			struct job *p = realloc(*jobs, grown * sizeof(struct job));
+			if(p == NULL) {
+				nomem = 1;
+				break;
+			}
+			*jobs = p;
+			cap = grown;
+		}
+		job = &(*jobs)[*count];
+		job->rom = malloc(strlen(line + offset) + 1);
+		if(job->rom == NULL) {
+			nomem = 1;
+			break;
+		}
+		strcpy(job->rom, line + offset);
+		job->budget = budget;
+		job->frames = kind[0] == 'f';
+		++*count;
+	}
+	fclose(f);
+	if(nomem) {
+		fprintf(stderr, "%s: out of memory\n", manifest);
+		batch_free_jobs(*jobs, *count);
+		*jobs = NULL;
+		*count = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* Runs every job in the manifest on threads workers, 0 for one per core. */
+int batch_run(const char *manifest, unsigned threads, int jit, FILE *out) {
+	struct batch b;
+	struct worker *workers;
+	
+	if(batch_parse(manifest, &b.jobs, &b.njobs)) {
+		return -1;
+	}
+	if(b.njobs == 0) {
+		fprintf(stderr, "%s: no jobs\n", manifest);
+		free(b.jobs);
+		return -1;
+	}
+	if(threads == 0) {
+		threads = clock_cores();
+	}
+	if(threads > b.njobs) {
+		threads = b.njobs;
+	}
+	
+	b.out = out;
+	b.jit = jit;
+	b.nqueues = threads;
+	b.queues = calloc(threads, sizeof(struct deque));
+	workers = calloc(threads, sizeof(struct worker));
+	for(unsigned i = 0; b.queues && i < threads; ++i) {
+		b.queues[i].jobs = malloc(b.njobs * sizeof(unsigned));
+		if(b.queues[i].jobs == NULL) {
+			free(workers);
+			workers = NULL;
+			break;
+		}
+	}
+	if(b.queues == NULL || workers == NULL) {
+		fprintf(stderr, "%s: out of memory\n", manifest);
+		for(unsigned i = 0; b.queues && i < threads; ++i) {
+			free(b.queues[i].jobs);
+		}
+		free(b.queues);
+		free(workers);
+		batch_free_jobs(b.jobs, b.njobs);
+		return -1;
+	}
+	pthread_mutex_init(&b.out_lock, NULL);
+	for(unsigned i = 0; i < threads; ++i) {
+		pthread_mutex_init(&b.queues[i].lock, NULL);
+	}
+	/* deal the jobs out round robin so long runs spread out to begin with */
+	for(unsigned i = 0; i < b.njobs; ++i) {
+		struct deque *q = &b.queues[i % threads];
+		q->jobs[q->tail++] = i;
+	}
+	
+	for(unsigned i = 0; i < threads; ++i) {
+		workers[i].batch = &b;
+		workers[i].id = i;
+		pthread_create(&workers[i].thread, NULL, batch_worker, &workers[i]);
+	}
+	for(unsigned i = 0; i < threads; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	
+	for(unsigned i = 0; i < threads; ++i) {
+		pthread_mutex_destroy(&b.queues[i].lock);
+		free(b.queues[i].jobs);
+	}
+	pthread_mutex_destroy(&b.out_lock);
+	batch_free_jobs(b.jobs, b.njobs);
+	free(b.queues);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Headless benchmark, runs a rom for a fixed budget with nothing attached and
+ * reports throughput as a single JSON object. Every trial starts from a fresh
+ * machine so the trials are identical work.
+ */
+
+#include "failboy.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct trial {
+	uint64_t cycles;
+	uint64_t instrs;
+	uint64_t wall_ns;
+	int jit;
+	int aot;
+};
+
+static int bench_trial(const char *rom, uint64_t budget, int frames, int jit, struct trial *t) {
+	struct gb *gb = gb_alloc();
+	uint64_t start;
+	
+	if(cart_load(gb, rom)) {
+		gb_free(gb);
+		return -1;
+	}
+	cpu_bios_init(gb);
+	t->jit = jit && !jit_enable(gb);
+	t->aot = gb->aot != NULL;
+	
+	start = clock_ns();
+	if(frames) {
+		for(uint64_t i = 0; i < budget; ++i) {
+			run_frame(gb);
+		}
+	} else {
+		run_cycles(gb, budget);
+	}
+	t->wall_ns = clock_ns() - start;
+	t->cycles = gb->cycle_counter;
+	t->instrs = gb->instr_counter;
+	
+	gb_free(gb);
+	return 0;
+}
+
+static int trial_cmp(const void *a, const void *b) {
+	const struct trial *x = a;
+	const struct trial *y = b;
+	return (x->wall_ns > y->wall_ns) - (x->wall_ns < y->wall_ns);
+}
+
+static void bench_stats(FILE *out, const char *name, const struct trial *t) {
+	double secs = t->wall_ns / 1e9;
+	fprintf(out, ",\"%s\":{\"wall_ns\":%llu,\"mips\":%.3f,\"cycles_per_sec\":%.0f,"
+		"\"frames_per_sec\":%.2f,\"realtime\":%.2f,\"ns_per_instr\":%.3f}",
+		name, (unsigned long long)t->wall_ns,
+		t->instrs / secs / 1e6,
+		t->cycles / secs,
+		t->cycles / (double)FRAME_CYCLES / secs,
+		t->cycles / (double)CPU_CLOCK / secs,
+		t->instrs ? t->wall_ns / (double)t->instrs : 0.0);
+}
+
+/* Budget is in frames when frames is set, otherwise in cycles. jit asks for
+ * the recompiler, the output says whether it was actually used. */
+int bench_run(const char *rom, uint64_t budget, int frames, unsigned trials, unsigned warmup, int jit, FILE *out) {
+	struct trial *t;
+	
+	if(trials == 0) {
+		trials = 1;
+	}
+	t = calloc(trials, sizeof(struct trial));
+	for(unsigned i = 0; i < warmup; ++i) {
+		if(bench_trial(rom, budget, frames, jit, &t[0])) {
+			fprintf(stderr, "%s: could not load rom\n", rom);
+			free(t);
+			return -1;
+		}
+	}
+	for(unsigned i = 0; i < trials; ++i) {
+		if(bench_trial(rom, budget, frames, jit, &t[i])) {
+			fprintf(stderr, "%s: could not load rom\n", rom);
+			free(t);
+			return -1;
+		}
+	}
+	
+	fputs("{\"rom\":", out);
+	json_string(out, rom, strlen(rom));
+	fprintf(out, ",\"core\":\"%s\",\"jit\":%s,\"aot\":%s,\"cycles\":%llu,\"instructions\":%llu,\"warmup\":%u,\"trials\":[",
+		cpu_core, t[0].jit ? "true" : "false", t[0].aot ? "true" : "false",
+		(unsigned long long)t[0].cycles, (unsigned long long)t[0].instrs, warmup);
+	for(unsigned i = 0; i < trials; ++i) {
+		fprintf(out, "%s%llu", i ? "," : "", (unsigned long long)t[i].wall_ns);
+	}
+	fputc(']', out);
+	qsort(t, trials, sizeof(struct trial), trial_cmp);
+	bench_stats(out, "best", &t[0]);
+	bench_stats(out, "median", &t[trials / 2]);
+	fputs("}\n", out);
+	
+	free(t);
+	return 0;
+}
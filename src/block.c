@@ -0,0 +1,391 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Predecoded basic blocks. The first time the table core reaches a PC it
+ * decodes the straight line run of instructions from there up to the next
+ * jump, call, return or the end of the memory region (an instruction whose
+ * operands are past it is left to a single step), resolving each opcode
+ * (and the CB prefix) to its handler, its operand bytes and its cost. After
+ * that the block runs from the cache without fetching or decoding anything.
+ *
+ * Blocks are keyed by PC and the ROM bank mapped at 4000-7FFF, so switching
+ * banks never needs a flush. Only ROM, work ram (and its echo) and high ram
+ * are cached. For the rams every 16 byte line that holds cached code is
+ * flagged and its work ram page loses its direct write mapping, so stores go
+ * through wram_write/hram_write, which drop any block on the line.
+ *
+ * ROM blocks with a translation built in (aot.c) run that from the start.
+ * With gb->jit set, the other ROM blocks that keep getting run are handed to
+ * jit.c and from then on run as native code. RAM blocks always stay
+ * interpreted.
+ *
+ * A block that only polls an IO register and jumps back to itself is an idle
+ * loop. Once it goes round without changing anything, the rounds up to the
+ * next event or PPU mode change are skipped, they would all read the same
+ * value.
+ */
+
+#include "block.h"
+#include "cpu_instr_fuse.h"
+#include <stdlib.h>
+
+void block_alloc(struct gb *gb) {
+	gb->blocks = calloc(1, sizeof(struct block_cache));
+}
+
+void block_free(struct gb *gb) {
+	free(gb->blocks);
+	gb->blocks = NULL;
+}
+
+/* Drops every block, for when the rom changes under us. */
+void block_flush(struct gb *gb) {
+	for(unsigned i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+		gb->blocks->blocks[i].count = 0;
+		gb->blocks->blocks[i].code = NULL;
+	}
+}
+
+/* folds the work ram echo onto c000-ddff */
+static uint16_t block_fold(uint16_t pc) {
+	return pc >= 0xE000 && pc < 0xFE00 ? pc - 0x2000 : pc;
+}
+
+/* Which cacheable region the address is in, 0 for none. Blocks never
+ * cross from one region into the next. */
+static unsigned block_region(uint16_t pc) {
+	if(pc < 0x4000) return 1;
+	if(pc < 0x8000) return 2;
+	if(pc >= 0xC000 && pc < 0xE000) return 3;
+	if(pc >= 0xE000 && pc < 0xFE00) return 4;
+	if(pc >= 0xFF80 && pc < 0xFFFF) return 5;
+	return 0;
+}
+
+/* Ends a block, anything that jumps or changes the interrupt state. */
+int block_ends(uint8_t op) {
+	switch(op) {
+		case 0x10: case 0x76: /* STOP HALT */
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: /* JR */
+		case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: /* JP */
+		case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: /* CALL */
+		case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: /* RET */
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: /* RST */
+		case 0xF3: case 0xFB: /* DI EI */
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Whether op can be in a fused group, last says if it is the last op of the
+ * group. The group runs whole, so only its last op may end the block or
+ * store. A store can stop the run (serial output, and LD B,B as well) and the
+ * stop has to come after the op that caused it.
+ */
+int block_can_fuse(uint8_t op, int last) {
+	if(op == 0xCB || instr_map[op] == XXX) {
+		return 0;
+	}
+	if(last) {
+		return 1;
+	}
+	switch(op) {
+		case 0x02: case 0x08: case 0x12: case 0x22: case 0x32: case 0x34: case 0x35: case 0x36:
+		case 0xC5: case 0xD5: case 0xE5: case 0xF5: case 0xE0: case 0xE2: case 0xEA:
+		case 0x40: /* LD B,B */
+			return 0;
+	}
+	return !(op >= 0x70 && op < 0x78) && !block_ends(op);
+}
+
+static void block_protect(struct gb *gb, uint16_t start, uint16_t end) {
+	for(unsigned a = start; a < end; a += 0x10) {
+		gb->blocks->lines[(a - 0xC000) >> 4] = 1;
+	}
+	gb->blocks->lines[(end - 1 - 0xC000) >> 4] = 1;
+	if(start < 0xE000) {
+		for(unsigned page = start >> 8; page <= (unsigned)(end - 1) >> 8; ++page) {
+			gb->writepage[page] = NULL;
+			if(page + 0x20 < 0xFE) {
+				gb->writepage[page + 0x20] = NULL;
+			}
+		}
+	}
+}
+
+/* The fused group from instr_fused starting at ops[i], if any. */
+static const struct fused_op *block_fused_at(const struct block *b, unsigned i) {
+	for(unsigned k = 0; k < instr_nfused; ++k) {
+		const struct fused_op *f = &instr_fused[k];
+		unsigned j = 0;
+		if(i + f->n > b->count) {
+			continue;
+		}
+		while(j < f->n && b->ops[i + j].op == f->ops[j] && block_can_fuse(f->ops[j], j + 1 == f->n)) {
+			++j;
+		}
+		if(j == f->n) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/* Fills in the fused copy of the ops, the operand bytes of a group are
+ * packed in order. */
+static void block_fuse(struct block *b) {
+	unsigned i = 0;
+	b->nfused = 0;
+	b->span = 0;
+	for(unsigned k = 0; k + 1 < b->count; ++k) {
+		b->span += b->ops[k].cycles;
+	}
+	while(i < b->count) {
+		const struct fused_op *f = block_fused_at(b, i);
+		struct block_op *o = &b->fused[b->nfused++];
+		*o = b->ops[i];
+		if(f) {
+			unsigned shift = 8 * (instr_length[o->op] - 1);
+			o->fn = f->fn;
+			for(unsigned j = 1; j < f->n; ++j) {
+				const struct block_op *next = &b->ops[i + j];
+				o->imm |= next->imm << shift;
+				/* the handler adds the cycles of the ones before */
+				o->cycles = next->cycles;
+				shift += 8 * (instr_length[next->op] - 1);
+			}
+			o->n = f->n;
+		}
+		i += o->n;
+	}
+	if(b->nfused == b->count) {
+		b->nfused = 0;
+	}
+}
+
+/* Registers that only change when an event fires or the PPU changes mode,
+ * the IDLE_ bits for them. DIV and TIMA count with the clock, so they are not
+ * in here. */
+static int block_idle_reg(uint16_t address) {
+	switch(address) {
+		case 0xFF00: /* P1 */
+		case 0xFF02: /* SC */
+			return IDLE_LOOP;
+		case 0xFF0F: /* IF */
+		case 0xFF41: /* STAT */
+		case 0xFF44: /* LY */
+			return IDLE_LOOP | IDLE_PPU;
+	}
+	return 0;
+}
+
+/*
+ * Could the block be an idle loop? It has to end in a JR back to its own
+ * start, and everything before that may only load A from an idle register
+ * or test A, so nothing is stored and nothing but A and F changes.
+ */
+static int block_idle_ops(const struct block *b, uint16_t start, uint16_t end) {
+	const struct block_op *jr = &b->ops[b->count - 1];
+	int idle = IDLE_LOOP;
+	if((jr->op != 0x18 && (jr->op & 0xE7) != 0x20) || (uint16_t)(end + (int8_t)jr->imm) != start) {
+		return 0;
+	}
+	for(unsigned i = 0; i + 1 < b->count; ++i) {
+		const struct block_op *o = &b->ops[i];
+		int reg;
+		switch(o->op) {
+			case 0xF0: /* LDH A,(n) */
+			case 0xFA: /* LD A,(nn) */
+				reg = block_idle_reg(o->op == 0xF0 ? 0xFF00 | o->imm : o->imm);
+				if(!reg) {
+					return 0;
+				}
+				idle |= reg;
+				break;
+			case 0xE6: case 0xEE: case 0xF6: case 0xFE: /* AND XOR OR CP n */
+			case 0xA7: case 0xAF: case 0xB7: case 0xBF: /* AND XOR OR CP A */
+				break;
+			case 0xCB: /* BIT b,A */
+				if((o->imm & 0xC7) != 0x47) {
+					return 0;
+				}
+				break;
+			default:
+				return 0;
+		}
+	}
+	return idle;
+}
+
+static void block_build(struct gb *gb, struct block *b, uint32_t key, uint16_t pc) {
+	uint16_t start = pc;
+	unsigned region = block_region(pc);
+	b->key = key;
+	b->start = block_fold(pc);
+	b->count = 0;
+	b->region = region;
+	b->hits = 0;
+	b->code = NULL;
+	do {
+		struct block_op *o;
+		uint8_t op = read(gb, pc);
+		uint8_t len = instr_length[op];
+		/* the operand bytes have to come from the same region, the key only
+		 * has the bank of the start */
+		if(block_region(pc + len - 1) != region) {
+			break;
+		}
+		o = &b->ops[b->count++];
+		o->imm = len == 3 ? read16(gb, pc + 1) : len == 2 ? read(gb, pc + 1) : 0;
+		o->op = op;
+		o->n = 1;
+		if(op == 0xCB) {
+			o->fn = instr_cb_map[o->imm];
+			o->cycles = instr_cb_timing[o->imm];
+			o->skip = 2;
+		} else {
+			o->fn = instr_map[op];
+			o->cycles = instr_timing[op];
+			o->skip = 1;
+		}
+		pc += len;
+		if(block_ends(op)) {
+			break;
+		}
+	} while(b->count < BLOCK_OPS && block_region(pc) == region);
+	if(!b->count) {
+		return;
+	}
+	if(gb->aot && region <= 2) {
+		b->code = aot_find(gb, key);
+	}
+	b->end = block_fold(pc - 1) + 1;
+	b->idle = block_idle_ops(b, start, pc);
+	b->nfused = 0;
+	if(region > 2) {
+		block_protect(gb, b->start, b->end);
+	} else if(!gb->blocks->unfused) {
+		block_fuse(b);
+	}
+}
+
+static struct block *block_lookup(struct gb *gb, uint16_t pc) {
+	unsigned region = block_region(pc);
+	uint32_t key;
+	struct block *b;
+	if(!region) {
+		return NULL;
+	}
+	key = region == 2 ? (uint32_t)gb->rom_bank << 16 | pc : pc;
+	b = &gb->blocks->blocks[(key * 2654435761u) >> (32 - BLOCK_CACHE_BITS)];
+	if(!b->count || b->key != key) {
+		block_build(gb, b, key, pc);
+	}
+	/* an instruction that runs into the next region is never cached */
+	return b->count ? b : NULL;
+}
+
+/* Called on stores to work ram or high ram lines that hold cached code. */
+void block_invalidate(struct gb *gb, uint16_t address) {
+	uint16_t a = block_fold(address);
+	uint8_t *line = &gb->blocks->lines[(a - 0xC000) >> 4];
+	if(!*line) {
+		return;
+	}
+	*line = 0;
+	a &= 0xFFF0;
+	for(unsigned i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+		struct block *b = &gb->blocks->blocks[i];
+		if(b->count && b->start >= 0xC000 && b->start < a + 0x10 && b->end > a) {
+			b->count = 0;
+		}
+	}
+}
+
+/* count is read every time round, a RAM block may drop itself */
+static void block_run(struct gb *gb, const struct block_op *ops, const uint8_t *count) {
+	for(unsigned i = 0; i < *count; ++i) {
+		const struct block_op *o = &ops[i];
+		gb->r.PC += o->skip;
+		gb->imm = o->imm;
+		o->fn(gb);
+		gb->cycle_counter += o->cycles << 2;
+		gb->instr_counter += o->n;
+		if(gb->cycle_counter >= gb->until) {
+			break;
+		}
+	}
+}
+
+/*
+ * An idle loop went round once from r. If that left every register as it
+ * was, the next round reads the same value and does the same again, and
+ * only an event can change the value, or the PPU changing mode for what it
+ * drives. So the rounds that would end before either are skipped, and the
+ * one that reaches it still runs, leaving the run exactly where it would
+ * have stopped.
+ */
+static void block_idle(struct gb *gb, uint8_t idle, const struct registers *r, uint64_t cycles, uint64_t instrs) {
+	uint64_t round = gb->cycle_counter - cycles;
+	uint64_t until = gb->until;
+	uint64_t n;
+	if((idle & IDLE_PPU) && gb->ppu_next < until) {
+		until = gb->ppu_next;
+	}
+	if(gb->cycle_counter >= until || gb->r.PC != r->PC || gb->r.AF != r->AF
+		|| gb->r.BC != r->BC || gb->r.DE != r->DE || gb->r.HL != r->HL || gb->r.SP != r->SP) {
+		return;
+	}
+	n = (until - gb->cycle_counter - 1) / round;
+	gb->cycle_counter += n * round;
+	gb->instr_counter += n * (gb->instr_counter - instrs);
+}
+
+static inline void block_go(struct gb *gb, struct block *b) {
+	if(b->code) {
+		b->code(gb);
+	} else if(b->nfused && gb->cycle_counter + (b->span << 2) < gb->until) {
+		/* the fused groups run whole, so only if the run can not end inside
+		 * the block, other than by cpu_stop() on its last op */
+		block_run(gb, b->fused, &b->nfused);
+	} else {
+		block_run(gb, b->ops, &b->count);
+	}
+}
+
+/* Runs the block at PC, or a single step where nothing can be cached. Stops
+ * early once cycle_counter reaches until, or if the block drops itself. */
+void block_exec(struct gb *gb) {
+	struct block *b = block_lookup(gb, gb->r.PC);
+	if(!b) {
+		cpu_step(gb);
+		return;
+	}
+	if(gb->jit && !b->code && b->region <= 2 && ++b->hits >= JIT_HOT) {
+		jit_compile(gb, b);
+	}
+	if(b->idle) {
+		/* idle blocks never store, so b is still there afterwards */
+		struct registers r = gb->r;
+		uint64_t cycles = gb->cycle_counter;
+		uint64_t instrs = gb->instr_counter;
+		block_go(gb, b);
+		block_idle(gb, b->idle, &r, cycles, instrs);
+	} else {
+		block_go(gb, b);
+	}
+}
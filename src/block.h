@@ -0,0 +1,89 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _BLOCK_H_
+#define _BLOCK_H_
+
+/* The predecoded blocks of block.c, shared with the recompiler in jit.c. */
+
+#include "failboy.h"
+#include "cpu_instr.h"
+
+#define BLOCK_CACHE_BITS	11
+#define BLOCK_CACHE_SIZE	(1 << BLOCK_CACHE_BITS)
+#define BLOCK_OPS	16
+#define BLOCK_LINES	(0x4000 >> 4) /* c000-ffff */
+/* block.idle, a loop that only polls IO, and whether what it reads comes
+ * from the PPU */
+#define IDLE_LOOP	0x01
+#define IDLE_PPU	0x02
+/* runs of a ROM block before jit.c compiles it */
+#define JIT_HOT	8
+
+struct block_op {
+	instruction_f fn;
+	uint32_t imm;
+	uint8_t op; /* 0xCB for the CB ops, imm holds the second byte */
+	uint8_t skip; /* bytes before the handler's own operand fetches */
+	uint8_t cycles;
+	uint8_t n; /* instructions, more than 1 for a fused group */
+};
+
+struct block {
+	uint32_t key;
+	uint16_t start, end; /* ram blocks use the echo folded address */
+	uint8_t count; /* 0 when empty or dropped */
+	uint8_t region;
+	uint16_t hits;
+	uint8_t idle; /* a polling loop, IDLE_ bits, see block_idle() */
+	void (*code)(struct gb *); /* native or translated version, see jit.c and aot.c */
+	struct block_op ops[BLOCK_OPS];
+	/* the same ops with the groups of cpu_instr_fuse.h fused, ROM only */
+	uint8_t nfused; /* 0 when nothing was fused */
+	uint16_t span; /* cycles of all ops but the last */
+	struct block_op fused[BLOCK_OPS];
+};
+
+struct block_cache {
+	struct block blocks[BLOCK_CACHE_SIZE];
+	uint8_t lines[BLOCK_LINES];
+	uint8_t unfused; /* run every op on its own, for jit_lockstep() */
+};
+
+/* one translated block of aot.c */
+struct aot_block {
+	uint32_t key; /* block cache key */
+	instruction_f fn;
+};
+
+/* the translation of one rom image */
+struct aot_rom {
+	uint32_t hash;
+	uint32_t size;
+	unsigned count;
+	const struct aot_block *blocks; /* sorted by key */
+};
+
+/* aot.c */
+instruction_f aot_find(struct gb *, uint32_t);
+
+/* block.c */
+int block_ends(uint8_t);
+int block_can_fuse(uint8_t, int);
+
+/* jit.c */
+void jit_compile(struct gb *, struct block *);
+
+#endif /* _BLOCK_H_ */
@@ -35,41 +35,51 @@ enum {
 	MODE_MBC1_4_32 = 1
 };
 
-static uint8_t *rom;
-static uint8_t *ram;
-
-static uint8_t cart_mode = MODE_MODELESS;
-static uint8_t rom_bank = 1;
-static uint8_t ram_bank = 0;
-static unsigned int size;
-
-uint8_t nil_read(uint16_t address) { return 0; }
-void nil_write(uint16_t address, uint8_t value) { }
-
-static read_f ext0_read_f = nil_read; /* 0000-3fff  */
-static read_f ext1_read_f = nil_read; /* 4000-7fff */
-static read_f ext2_read_f = nil_read; /* a000-bfff */
-
-static write_f ext0_write_f = nil_write; /* 0000-3fff  */
-static write_f ext1_write_f = nil_write; /* 4000-7fff */
-static write_f ext2_write_f = nil_write; /* a000-bfff */
+uint8_t nil_read(struct gb *gb, uint16_t address) { return 0; }
+void nil_write(struct gb *gb, uint16_t address, uint8_t value) { }
+
+uint8_t ext0_read(struct gb *gb, uint16_t address) { return gb->ext0_read_f(gb, address); }
+uint8_t ext1_read(struct gb *gb, uint16_t address) { return gb->ext1_read_f(gb, address); }
+uint8_t ext2_read(struct gb *gb, uint16_t address) { return gb->ext2_read_f(gb, address); }
+void ext0_write(struct gb *gb, uint16_t address, uint8_t value) { gb->ext0_write_f(gb, address, value); }
+void ext1_write(struct gb *gb, uint16_t address, uint8_t value) { gb->ext1_write_f(gb, address, value); }
+void ext2_write(struct gb *gb, uint16_t address, uint8_t value) { gb->ext2_write_f(gb, address, value); }
+
+uint8_t rom_read(struct gb *gb, uint16_t address) {
+	return gb->rom[address];
+}
 
-uint8_t ext0_read(uint16_t address) { return ext0_read_f(address); }
-uint8_t ext1_read(uint16_t address) { return ext1_read_f(address); }
-uint8_t ext2_read(uint16_t address) { return ext2_read_f(address); }
-void ext0_write(uint16_t address, uint8_t value) { ext0_write_f(address, value); }
-void ext1_write(uint16_t address, uint8_t value) { ext1_write_f(address, value); }
-void ext2_write(uint16_t address, uint8_t value) { ext2_write_f(address, value); }
+uint8_t mbc1_1_read(struct gb *gb, uint16_t address) {
+	uint32_t offset = gb->rom_bank * 0x4000 + address - 0x4000;
+	/* only an image cut short has banks missing, nothing drives the bus */
+	if(offset >= gb->rom_size) {
+		return 0xFF;
+	}
+	return gb->rom[offset];
+}
 
-uint8_t rom_read(uint16_t address) {
-	return rom[address];
+/* The cart only has the bank lines its rom needs, the rest of the bank
+ * number is ignored. */
+static uint8_t cart_bank_mask(struct gb *gb) {
+	unsigned banks = 1;
+	while(banks < gb->rom_size / 0x4000 && banks < 0x100) {
+		banks <<= 1;
+	}
+	return banks - 1;
 }
 
-uint8_t mbc1_1_read(uint16_t address) {
-	return rom[rom_bank * 0x4000 + address - 0x4000];
+/* Points the 4000-7fff pages straight at the selected rom bank. A bank past
+ * the end of an image whose size is not a power of two reads as FF through
+ * mbc1_1_read. */
+static void cart_map_bank(struct gb *gb) {
+	if((gb->rom_bank + 1) * 0x4000 <= gb->rom_size) {
+		mem_map_read(gb, 0x40, 0x40, gb->rom + gb->rom_bank * 0x4000);
+	} else {
+		mem_map_read(gb, 0x40, 0x40, NULL);
+	}
 }
 
-void mbc1_0_write(uint16_t address, uint8_t value) {
+void mbc1_0_write(struct gb *gb, uint16_t address, uint8_t value) {
 	/* 0000-3fff  */
 	if(address < 0x2000) {
 		/* enable disable ram */
@@ -83,63 +93,88 @@ void mbc1_0_write(uint16_t address, uint8_t value) {
 		if(value == 0) {
 			value = 1;
 		}
-		rom_bank = value;
+		gb->rom_bank = value & cart_bank_mask(gb);
+		cart_map_bank(gb);
 	}
 }
 
-void mbc1_1_write(uint16_t address, uint8_t value) {
+void mbc1_1_write(struct gb *gb, uint16_t address, uint8_t value) {
 	/* 4000-7fff */
 	if(address < 0x6000) {
-		if(cart_mode == MODE_MBC1_16_8) {
+		if(gb->cart_mode == MODE_MBC1_16_8) {
 			/* 16/8  rom address lines */
 		} else {
 			/* 4/32  ram bank select */
-			ram_bank = value & 3;
+			gb->ram_bank = value & 3;
 		}
 	} else {
-		cart_mode = value & 1;
-		if(cart_mode == MODE_MBC1_16_8) {
-			ram_bank = 0;
+		gb->cart_mode = value & 1;
+		if(gb->cart_mode == MODE_MBC1_16_8) {
+			gb->ram_bank = 0;
 		}
 	}
 }
 
-void cart_mem_reset() {
-	ext0_read_f = ext1_read_f = ext2_read_f = nil_read;
-	ext0_write_f = ext1_write_f = ext2_write_f = nil_write;
-	rom_bank = 1;
-	rom = NULL;
-	ram = NULL;
+void cart_mem_reset(struct gb *gb) {
+	gb->ext0_read_f = gb->ext1_read_f = gb->ext2_read_f = nil_read;
+	gb->ext0_write_f = gb->ext1_write_f = gb->ext2_write_f = nil_write;
+	gb->cart_mode = MODE_MODELESS;
+	gb->rom_bank = 1;
+	gb->ram_bank = 0;
+	gb->rom = NULL;
+	gb->ram = NULL;
+	gb->aot = NULL;
+	mem_map_read(gb, 0x00, 0x80, NULL);
 }
 
-void cart_load(const char *filename) {
-	if(rom != NULL) {
-		cart_free();
+int cart_load(struct gb *gb, const char *filename) {
+	FILE *f;
+	if(gb->rom != NULL) {
+		cart_free(gb);
+	}
+	/* sb_file_load2 does not check for a missing file */
+	f = fopen(filename, "rb");
+	if(f == NULL) {
+		return -1;
+	}
+	fclose(f);
+	gb->rom = sb_file_load2(filename, &gb->rom_size);
+	assert2(gb->rom == NULL);
+	if(gb->rom_size < 0x150) {
+		/* not even a header */
+		cart_free(gb);
+		return -1;
 	}
-	rom = sb_file_load2(filename, &size);
-	assert2(rom == NULL);
-	switch(rom[0x147]) {
+	switch(gb->rom[0x147]) {
 		case CART_ROM_ONLY:
-			ext0_read_f = ext1_read_f = rom_read;
+			gb->ext0_read_f = gb->ext1_read_f = rom_read;
+			if(gb->rom_size >= 0x8000) {
+				mem_map_read(gb, 0x00, 0x80, gb->rom);
+			}
 			break;
 		case CART_MBC1:
-			cart_mode = MODE_MBC1_16_8;
-			ext0_read_f = rom_read;
-			ext1_read_f = mbc1_1_read;
-			ext0_write_f = mbc1_0_write;
-			ext1_write_f = mbc1_1_write;
+			gb->cart_mode = MODE_MBC1_16_8;
+			gb->ext0_read_f = rom_read;
+			gb->ext1_read_f = mbc1_1_read;
+			gb->ext0_write_f = mbc1_0_write;
+			gb->ext1_write_f = mbc1_1_write;
+			mem_map_read(gb, 0x00, 0x40, gb->rom);
+			cart_map_bank(gb);
 			break;
 		default:
 			break;
 	}
+	aot_attach(gb);
+	block_flush(gb);
+	return 0;
 }
 
-void cart_free() {
-	if(rom != NULL) {
-		free(rom);
+void cart_free(struct gb *gb) {
+	if(gb->rom != NULL) {
+		free(gb->rom);
 	}
-	if(ram != NULL) {
-		free(ram);
+	if(gb->ram != NULL) {
+		free(gb->ram);
 	}
-	cart_mem_reset();
+	cart_mem_reset(gb);
 }
@@ -16,39 +16,24 @@
 #include "failboy.h"
 #include "cpu_instr.h"
 #include "cpu_instr_cb.h"
+#include "cpu_instr_fuse.h"
 
-typedef void (*instruction_f)();
-typedef void (*instruction_cb_f)(uint8_t);
+void NOP(struct gb *gb) { }
+void XXX(struct gb *gb) { /* missing opcode */ }
 
-struct registers r;
-
-uint32_t cycle_counter = 0;
-
-void NOP() { }
-void XXX() { /* missing opcode */ }
-
-static const instruction_f instr_cb_map[64] = {
-	RLC_B, RLC_C, RLC_D, RLC_E, RLC_H, RLC_L, RLC_aHL, RLCA,	/* 00-07 */
-	RRC_B, RRC_C, RRC_D, RRC_E, RRC_H, RRC_L, RRC_aHL, RRCA,	/* 08-0f */
-	RL_B, RL_C, RL_D, RL_E, RL_H, RL_L, RL_aHL, RLA,	/* 10-17 */
-	RR_B, RR_C, RR_D, RR_E, RR_H, RR_L, RR_aHL, RRA,	/* 18-1f */
-	SLA_B, SLA_C, SLA_D, SLA_E, SLA_H, SLA_L, SLA_aHL, SLA_A,	/* 20-27 */
-	SRA_B, SRA_C, SRA_D, SRA_E, SRA_H, SRA_L, SRA_aHL, SRA_A,	/* 28-2f */
-	SWAP_B, SWAP_C, SWAP_D, SWAP_E, SWAP_H, SWAP_L, SWAP_aHL, SWAP_A,	/* 30-37 */
-	SRL_B, SRL_C, SRL_D, SRL_E, SRL_H, SRL_L, SRL_aHL, SRL_A,	/* 38-3f */
+#define CB_ENTRY(op, name, b, r) name,
+const instruction_f instr_cb_map[256] = {
+	CB_OPCODES(CB_ENTRY)
 };
+#undef CB_ENTRY
 
-static const instruction_cb_f instr_cb_bit_map[8] = {
-	BIT_b_B, BIT_b_C, BIT_b_D, BIT_b_E, BIT_b_H, BIT_b_L, BIT_b_aHL, BIT_b_A
-};
-static const instruction_cb_f instr_cb_res_map[8] = {
-	RES_b_B, RES_b_C, RES_b_D, RES_b_E, RES_b_H, RES_b_L, RES_b_aHL, RES_b_A
-};
-static const instruction_cb_f instr_cb_set_map[8] = {
-	SET_b_B, SET_b_C, SET_b_D, SET_b_E, SET_b_H, SET_b_L, SET_b_aHL, SET_b_A
+#define CB_ENTRY(op, name, b, r) #name,
+const char *const instr_cb_names[256] = {
+	CB_OPCODES(CB_ENTRY)
 };
+#undef CB_ENTRY
 
-static const uint8_t instr_cb_timing[256] = {
+const uint8_t instr_cb_timing[256] = {
 	2,2,2,2,2,2,4,2,2,2,2,2,2,2,4,2,
 	2,2,2,2,2,2,4,2,2,2,2,2,2,2,4,2,
 	2,2,2,2,2,2,4,2,2,2,2,2,2,2,4,2,
@@ -67,29 +52,13 @@ static const uint8_t instr_cb_timing[256] = {
 	2,2,2,2,2,2,4,2,2,2,2,2,2,2,4,2
 };
 
-static inline void step_cb() {
-	uint8_t op = rpc8();
-	if(op < 0x40) {
-		instr_cb_map[op]();
-		cycle_counter += instr_cb_timing[op] << 2;
-		return;
-	}
-	if(op < 0x80) { /* BIT */
-		instr_cb_bit_map[op & 7]((op>>3)&7);
-		cycle_counter += instr_cb_timing[op] << 2;
-		return;
-	}
-	if(op < 0xC0) { /* RES */
-		instr_cb_res_map[op & 7]((op>>3)&7);
-		cycle_counter += instr_cb_timing[op] << 2;
-		return;
-	}
-	/* SET */
-	instr_cb_set_map[op & 7]((op>>3)&7);
-	cycle_counter += instr_cb_timing[op] << 2;
+void step_cb(struct gb *gb) {
+	uint8_t op = rpc8(gb);
+	instr_cb_map[op](gb);
+	gb->cycle_counter += instr_cb_timing[op] << 2;
 }
 
-static const instruction_f instr_map[256] = {
+const instruction_f instr_map[256] = {
 	NOP, LD_BC_nn, LD_aBC_A, INC_BC, INC_B, DEC_B, LD_B_n, RLCA,	/* 00-07 */
 	LD_ann_SP, ADD_HL_BC, LD_A_aBC, DEC_BC, INC_C, DEC_C, LD_C_n, RRCA,	/* 08-0f */
 	STOP, LD_DE_nn, LD_aDE_A, INC_DE, INC_D, DEC_D, LD_D_n, RLA,	/* 10-17 */
@@ -101,7 +70,7 @@ static const instruction_f instr_map[256] = {
 	LD_B_B, LD_B_C, LD_B_D, LD_B_E, LD_B_H, LD_B_L, LD_B_aHL, LD_B_A,	/* 40-47 */
 	LD_C_B, LD_C_C, LD_C_D, LD_C_E, LD_C_H, LD_C_L, LD_C_aHL, LD_C_A,	/* 48-4f */
 	LD_D_B, LD_D_C, LD_D_D, LD_D_E, LD_D_H, LD_D_L, LD_D_aHL, LD_D_A,	/* 50-57 */
-	LD_E_B, LD_E_C, LD_E_D, LD_E_E, LD_E_H, LD_E_L, LD_E_aHL, LD_E_A,	/* 50-57 */
+	LD_E_B, LD_E_C, LD_E_D, LD_E_E, LD_E_H, LD_E_L, LD_E_aHL, LD_E_A,	/* 58-5f */
 	LD_H_B, LD_H_C, LD_H_D, LD_H_E, LD_H_H, LD_H_L, LD_H_aHL, LD_H_A,	/* 60-67 */
 	LD_L_B, LD_L_C, LD_L_D, LD_L_E, LD_L_H, LD_L_L, LD_L_aHL, LD_L_A,	/* 68-6f */
 	LD_aHL_B, LD_aHL_C, LD_aHL_D, LD_aHL_E, LD_aHL_H, LD_aHL_L, HALT, LD_aHL_A,	/* 70-77 */
@@ -124,8 +93,43 @@ static const instruction_f instr_map[256] = {
 	LDHL_SP_n, LD_SP_HL, LD_A_ann, EI, XXX, XXX, CP_n, RST38,	/* f8-ff */
 };
 
+/* handler names, for the tools and profiling output */
+const char *const instr_names[256] = {
+	"NOP", "LD_BC_nn", "LD_aBC_A", "INC_BC", "INC_B", "DEC_B", "LD_B_n", "RLCA",	/* 00-07 */
+	"LD_ann_SP", "ADD_HL_BC", "LD_A_aBC", "DEC_BC", "INC_C", "DEC_C", "LD_C_n", "RRCA",	/* 08-0f */
+	"STOP", "LD_DE_nn", "LD_aDE_A", "INC_DE", "INC_D", "DEC_D", "LD_D_n", "RLA",	/* 10-17 */
+	"JR_n", "ADD_HL_DE", "LD_A_aDE", "DEC_DE", "INC_E", "DEC_E", "LD_E_n", "RRA",	/* 18-1f */
+	"JR_NZ_n", "LD_HL_nn", "LDI_aHL_A", "INC_HL", "INC_H", "DEC_H", "LD_H_n", "DAA",	/* 20-27 */
+	"JR_Z_n", "ADD_HL_HL", "LDI_A_aHL", "DEC_HL", "INC_L", "DEC_L", "LD_L_n", "CPL",	/* 28-2f */
+	"JR_NC_n", "LD_SP_nn", "LDD_aHL_A", "INC_SP", "INC_aHL", "DEC_aHL", "LD_aHL_n", "SCF",	/* 30-37 */
+	"JR_C_n", "ADD_HL_SP", "LDD_A_aHL", "DEC_SP", "INC_A", "DEC_A", "LD_A_n", "CCF",	/* 38-3f */
+	"LD_B_B", "LD_B_C", "LD_B_D", "LD_B_E", "LD_B_H", "LD_B_L", "LD_B_aHL", "LD_B_A",	/* 40-47 */
+	"LD_C_B", "LD_C_C", "LD_C_D", "LD_C_E", "LD_C_H", "LD_C_L", "LD_C_aHL", "LD_C_A",	/* 48-4f */
+	"LD_D_B", "LD_D_C", "LD_D_D", "LD_D_E", "LD_D_H", "LD_D_L", "LD_D_aHL", "LD_D_A",	/* 50-57 */
+	"LD_E_B", "LD_E_C", "LD_E_D", "LD_E_E", "LD_E_H", "LD_E_L", "LD_E_aHL", "LD_E_A",	/* 58-5f */
+	"LD_H_B", "LD_H_C", "LD_H_D", "LD_H_E", "LD_H_H", "LD_H_L", "LD_H_aHL", "LD_H_A",	/* 60-67 */
+	"LD_L_B", "LD_L_C", "LD_L_D", "LD_L_E", "LD_L_H", "LD_L_L", "LD_L_aHL", "LD_L_A",	/* 68-6f */
+	"LD_aHL_B", "LD_aHL_C", "LD_aHL_D", "LD_aHL_E", "LD_aHL_H", "LD_aHL_L", "HALT", "LD_aHL_A",	/* 70-77 */
+	"LD_A_B", "LD_A_C", "LD_A_D", "LD_A_E", "LD_A_H", "LD_A_L", "LD_A_aHL", "LD_A_A",	/* 78-7f */
+	"ADD_A_B", "ADD_A_C", "ADD_A_D", "ADD_A_E", "ADD_A_H", "ADD_A_L", "ADD_A_aHL", "ADD_A_A",	/* 80-87 */
+	"ADC_A_B", "ADC_A_C", "ADC_A_D", "ADC_A_E", "ADC_A_H", "ADC_A_L", "ADC_A_aHL", "ADC_A_A",	/* 88-8f */
+	"SUB_B", "SUB_C", "SUB_D", "SUB_E", "SUB_H", "SUB_L", "SUB_aHL", "SUB_A",	/* 90-97 */
+	"SBC_A_B", "SBC_A_C", "SBC_A_D", "SBC_A_E", "SBC_A_H", "SBC_A_L", "SBC_A_aHL", "SBC_A_A",	/* 98-9f */
+	"AND_B", "AND_C", "AND_D", "AND_E", "AND_H", "AND_L", "AND_aHL", "AND_A",	/* a0-a7 */
+	"XOR_B", "XOR_C", "XOR_D", "XOR_E", "XOR_H", "XOR_L", "XOR_aHL", "XOR_A",	/* a8-af */
+	"OR_B", "OR_C", "OR_D", "OR_E", "OR_H", "OR_L", "OR_aHL", "OR_A",	/* b0-b7 */
+	"CP_B", "CP_C", "CP_D", "CP_E", "CP_H", "CP_L", "CP_aHL", "CP_A",	/* b8-bf */
+	"RET_NZ", "POP_BC", "JP_NZ", "JP", "CALL_NZ_nn", "PUSH_BC", "ADD_A_n", "RST00",	/* c0-c7 */
+	"RET_Z", "RET", "JP_Z", "step_cb", "CALL_Z_nn", "CALL_nn", "ADC_A_n", "RST08",	/* c8-cf */
+	"RET_NC", "POP_DE", "JP_NC", "XXX", "CALL_NC_nn", "PUSH_DE", "SUB_n", "RST10",	/* d0-d7 */
+	"RET_C", "RETI", "JP_C", "XXX", "CALL_C_nn", "XXX", "SBC_A_n", "RST18",	/* d8-df */
+	"LDH_an_A", "POP_HL", "LD_aC_A", "XXX", "XXX", "PUSH_HL", "AND_n", "RST20",	/* e0-e7 */
+	"ADD_SP_n", "JP_HL", "LD_ann_A", "XXX", "XXX", "XXX", "XOR_n", "RST28",	/* e8-ef */
+	"LDH_A_an", "POP_AF", "LD_A_aC", "DI", "XXX", "PUSH_AF", "OR_n", "RST30",	/* f0-f7 */
+	"LDHL_SP_n", "LD_SP_HL", "LD_A_ann", "EI", "XXX", "XXX", "CP_n", "RST38",	/* f8-ff */
+};
 
-static const uint8_t instr_timing[256] = {
+const uint8_t instr_timing[256] = {
 	1,3,2,2,1,1,2,1,5,2,2,2,1,1,2,1,
 	0,3,2,2,1,1,2,1,3,2,2,2,1,1,2,1,
 	2,3,2,2,1,1,2,1,2,2,2,2,1,1,2,1,
@@ -133,7 +137,7 @@ static const uint8_t instr_timing[256] = {
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
-	2,2,2,2,2,2,0,2,1,1,1,1,1,1,2,1,
+	2,2,2,2,2,2,1,2,1,1,1,1,1,1,2,1,
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
 	1,1,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
@@ -144,55 +148,298 @@ static const uint8_t instr_timing[256] = {
 	3,3,2,1,0,4,2,4,3,2,4,1,0,0,2,4
 };
 
-void step() {
-	uint8_t op = rpc8();
-	instr_map[op]();
-	cycle_counter += instr_timing[op] << 2;
+/* in bytes, including the opcode and what the handler fetches */
+const uint8_t instr_length[256] = {
+	1,3,1,1,1,1,2,1,3,1,1,1,1,1,2,1,
+	1,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+	2,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+	2,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,3,3,3,1,2,1,1,1,3,2,3,3,2,1,
+	1,1,3,1,3,1,2,1,1,1,3,1,3,1,2,1,
+	2,1,1,1,1,1,2,1,2,1,3,1,1,1,2,1,
+	2,1,1,1,1,1,2,1,2,1,3,1,1,1,2,1
+};
+
+#define FUSE2_ENTRY(a, na, b, nb) { 2, { a, b }, na##_##nb },
+#define FUSE3_ENTRY(a, na, b, nb, c, nc) { 3, { a, b, c }, na##_##nb##_##nc },
+const struct fused_op instr_fused[] = {
+	FUSED_OPCODES(FUSE2_ENTRY, FUSE3_ENTRY)
+};
+#undef FUSE2_ENTRY
+#undef FUSE3_ENTRY
+const unsigned instr_nfused = sizeof(instr_fused) / sizeof(instr_fused[0]);
+
+/* Fetches, decodes and runs one instruction through instr_map. The HALT bug
+ * fetches the opcode without moving PC, see cpu_between(). */
+static void cpu_fetch(struct gb *gb, uint8_t skip) {
+	uint8_t op = read(gb, gb->r.PC);
+	gb->r.PC += skip;
+	if(instr_length[op] == 2) {
+		gb->imm = read(gb, gb->r.PC);
+	} else if(instr_length[op] == 3) {
+		gb->imm = read16(gb, gb->r.PC);
+	}
+	instr_map[op](gb);
+	gb->cycle_counter += instr_timing[op] << 2;
+	++gb->instr_counter;
+}
+
+/* One instruction and nothing else, for where blocks can not be cached. */
+void cpu_step(struct gb *gb) {
+	cpu_fetch(gb, 1);
+}
+
+#ifndef CORE_SWITCH
+const char *cpu_core = "table";
+
+void step(struct gb *gb) {
+	if(!cpu_between(gb, gb->cycle_counter + 4)) {
+		cpu_step(gb);
+	}
+}
+
+void cpu_run(struct gb *gb) {
+	do {
+		block_exec(gb);
+	} while(gb->cycle_counter < gb->until);
+}
+#endif /* CORE_SWITCH */
+
+/*
+ * Interrupts. gb->irq caches IME && (IE & IF) and is only worked out again
+ * when one of those changes, so it is the only thing looked at between runs.
+ * When it turns on during a run the run stops after the current instruction,
+ * the same way cpu_stop() does, so the cores never check for interrupts per
+ * instruction. cpu_between() then does the dispatch.
+ */
+void cpu_irq_update(struct gb *gb) {
+	gb->irq = gb->ime && (gb->ie & gb->iflag & 0x1F);
+	if(gb->irq) {
+		gb->until = 0;
+	}
+}
+
+/* Sets bits in IF. */
+void cpu_request(struct gb *gb, uint8_t bits) {
+	gb->iflag |= bits;
+	cpu_irq_update(gb);
+}
+
+/* DI and RETI, which take effect straight away. */
+void cpu_ime(struct gb *gb, uint8_t on) {
+	gb->ime = on;
+	gb->ei = 0;
+	cpu_irq_update(gb);
+}
+
+/* EI only sets IME after the instruction that follows it. The run stops
+ * here and cpu_between() counts that one instruction down. */
+void cpu_ei(struct gb *gb) {
+	gb->ei = 2;
+	gb->until = 0;
+}
+
+/* Calls the vector of the highest priority interrupt that is due, which
+ * takes five machine cycles, and acknowledges it in IF. */
+static void cpu_interrupt(struct gb *gb) {
+	uint8_t pending = gb->ie & gb->iflag & 0x1F;
+	uint8_t bit = pending & -pending;
+	uint16_t vector = 0x40;
+	while(!(bit & 1)) {
+		bit >>= 1;
+		vector += 8;
+	}
+	gb->iflag &= ~(pending & -pending);
+	gb->ime = 0;
+	gb->irq = 0;
+	gb->r.SP -= 2;
+	write16(gb, gb->r.SP, gb->r.PC);
+	gb->r.PC = vector;
+	gb->cycle_counter += 5 << 2;
+}
+
+/*
+ * HALT, the CPU stops until an interrupt is both requested and enabled. The
+ * run stops here and cpu_exec() moves the clock from event to event instead
+ * of running the core. If one is already pending HALT does not stop at all,
+ * and with IME off (not about to go on after EI) that is the HALT bug, the
+ * next opcode byte is read twice.
+ */
+void cpu_halt(struct gb *gb) {
+	if(gb->ie & gb->iflag & 0x1F) {
+		if(!gb->ime && !gb->ei) {
+			gb->halt_bug = 1;
+			gb->until = 0;
+		}
+		return;
+	}
+	gb->halted = 1;
+	gb->until = 0;
+}
+
+/*
+ * Everything that happens between instructions, outside the cores. In order:
+ * the EI delay, where the instruction after EI gets to run on its own before
+ * IME goes on. The instruction after the HALT bug, whose operands start at
+ * the opcode byte since PC never moved past it. A halted CPU, which wakes
+ * once IE & IF is set and otherwise moves the clock on to until, since only
+ * an event can change that. And the interrupt dispatch.
+ *
+ * Returns non zero if that took the place of the next instruction, so the
+ * core should not run now.
+ */
+int cpu_between(struct gb *gb, uint64_t until) {
+	if(gb->ei) {
+		if(--gb->ei) {
+			gb->until = 0;
+			return 0;
+		}
+		gb->ime = 1;
+		cpu_irq_update(gb);
+	}
+	if(gb->halt_bug) {
+		gb->halt_bug = 0;
+		cpu_fetch(gb, 0);
+		return 1;
+	}
+	if(gb->halted) {
+		if(!(gb->ie & gb->iflag & 0x1F)) {
+			if(gb->cycle_counter < until) {
+				gb->cycle_counter = until;
+			}
+			return 1;
+		}
+		gb->halted = 0;
+		if(gb->irq) {
+			/* one more machine cycle to wake up */
+			gb->cycle_counter += 4;
+		}
+	}
+	if(gb->irq) {
+		cpu_interrupt(gb);
+		return 1;
+	}
+	return 0;
+}
+
+/* Runs until cycle_counter reaches until, at least one instruction unless an
+ * event stops it first. The core only runs up to the next event at a time. */
+void cpu_exec(struct gb *gb, uint64_t until) {
+	do {
+		uint64_t next;
+		sched_run(gb);
+		if(gb->stop_reason) {
+			break;
+		}
+		next = sched_next(gb);
+		gb->until = next < until ? next : until;
+		if(!cpu_between(gb, gb->until)) {
+			cpu_run(gb);
+		}
+	} while(gb->cycle_counter < until && !gb->stop_reason);
+}
+
+/* Stops the current run after this instruction. The run calls will do
+ * nothing until stop_reason is cleared again. */
+void cpu_stop(struct gb *gb, uint8_t reason) {
+	gb->stop_reason = reason;
+	gb->until = 0;
+}
+
+/* The mooneye test roms signal their result with LD B,B and the registers
+ * set to the fibonacci numbers, or all 0x42 on failure. */
+void cpu_ldbb(struct gb *gb) {
+	if(gb->r.B == 3 && gb->r.C == 5 && gb->r.D == 8 && gb->r.E == 13 && gb->r.H == 21 && gb->r.L == 34) {
+		cpu_stop(gb, STOP_PASSED);
+	} else if(gb->r.B == 0x42 && gb->r.C == 0x42 && gb->r.D == 0x42
+		&& gb->r.E == 0x42 && gb->r.H == 0x42 && gb->r.L == 0x42) {
+		cpu_stop(gb, STOP_FAILED);
+	}
+}
+
+uint64_t run_cycles(struct gb *gb, uint64_t budget) {
+	uint64_t start = gb->cycle_counter;
+	if(gb->stop_reason) {
+		return 0;
+	}
+	cpu_exec(gb, start + budget);
+	return gb->cycle_counter - start;
+}
+
+uint64_t run_frame(struct gb *gb) {
+	uint64_t start = gb->cycle_counter;
+	if(gb->stop_reason) {
+		return 0;
+	}
+	cpu_exec(gb, (start / FRAME_CYCLES + 1) * FRAME_CYCLES);
+	return gb->cycle_counter - start;
+}
+
+/*
+ * Runs until pred returns non zero or budget cycles have passed. The predicate
+ * is checked once per scanline worth of cycles, not per instruction.
+ */
+uint64_t run_until(struct gb *gb, run_pred_f pred, void *arg, uint64_t budget) {
+	uint64_t start = gb->cycle_counter;
+	uint64_t end = start + budget;
+	while(gb->cycle_counter < end && !gb->stop_reason && !pred(gb, arg)) {
+		uint64_t until = gb->cycle_counter + LINE_CYCLES;
+		cpu_exec(gb, until < end ? until : end);
+	}
+	return gb->cycle_counter - start;
 }
 
-void cpu_bios_init() {
+void cpu_bios_init(struct gb *gb) {
 	/*
 	0x1 - Gameboy/Super Gameboy
 	0x11 - Gameboy Color
 	0xFF - Gameboy Pocket
 	 */
-	r.A = 0x1;
-	r.F = 0xB0;
-	r.BC = 0x13;
-	r.DE = 0xD8;
-	r.HL = 0x14D;
-	r.PC = 0x100;
-	r.SP = 0xFFFE;
+	gb->r.A = 0x1;
+	gb->r.F = 0xB0;
+	gb->r.BC = 0x13;
+	gb->r.DE = 0xD8;
+	gb->r.HL = 0x14D;
+	gb->r.PC = 0x100;
+	gb->r.SP = 0xFFFE;
 	
-	write(0xFF05, 0x00); // TIMA
-	write(0xFF06, 0x00); // TMA
-	write(0xFF07, 0x00); // TAC
-	write(0xFF10, 0x80); // NR10
-	write(0xFF11, 0xBF); // NR11
-	write(0xFF12, 0xF3); // NR12
-	write(0xFF14, 0xBF); // NR14
-	write(0xFF16, 0x3F); // NR21
-	write(0xFF17, 0x00); // NR22
-	write(0xFF19, 0xBF); // NR24
-	write(0xFF1A, 0x7F); // NR30
-	write(0xFF1B, 0xFF); // NR31
-	write(0xFF1C, 0x9F); // NR32
-	write(0xFF1E, 0xBF); // NR33
-	write(0xFF20, 0xFF); // NR41
-	write(0xFF21, 0x00); // NR42
-	write(0xFF22, 0x00); // NR43
-	write(0xFF23, 0xBF); // NR30
-	write(0xFF24, 0x77); // NR50
-	write(0xFF25, 0xF3); // NR51
-	write(0xFF26, 0xF1); // NR52 // 0xF1 GB, 0xF0 SGB
-	write(0xFF40, 0x91); // LCDC
-	write(0xFF42, 0x00); // SCY
-	write(0xFF43, 0x00); // SCX
-	write(0xFF45, 0x00); // LYC
-	write(0xFF47, 0xFC); // BGP
-	write(0xFF48, 0xFF); // OBP0
-	write(0xFF49, 0xFF); // OBP1
-	write(0xFF4A, 0x00); // WY
-	write(0xFF4B, 0x00); // WX
-	write(0xFFFF, 0x00); // IE
+	write(gb, 0xFF05, 0x00); // TIMA
+	write(gb, 0xFF06, 0x00); // TMA
+	write(gb, 0xFF07, 0x00); // TAC
+	write(gb, 0xFF10, 0x80); // NR10
+	write(gb, 0xFF11, 0xBF); // NR11
+	write(gb, 0xFF12, 0xF3); // NR12
+	write(gb, 0xFF14, 0xBF); // NR14
+	write(gb, 0xFF16, 0x3F); // NR21
+	write(gb, 0xFF17, 0x00); // NR22
+	write(gb, 0xFF19, 0xBF); // NR24
+	write(gb, 0xFF1A, 0x7F); // NR30
+	write(gb, 0xFF1B, 0xFF); // NR31
+	write(gb, 0xFF1C, 0x9F); // NR32
+	write(gb, 0xFF1E, 0xBF); // NR33
+	write(gb, 0xFF20, 0xFF); // NR41
+	write(gb, 0xFF21, 0x00); // NR42
+	write(gb, 0xFF22, 0x00); // NR43
+	write(gb, 0xFF23, 0xBF); // NR30
+	write(gb, 0xFF24, 0x77); // NR50
+	write(gb, 0xFF25, 0xF3); // NR51
+	write(gb, 0xFF26, 0xF1); // NR52 // 0xF1 GB, 0xF0 SGB
+	write(gb, 0xFF40, 0x91); // LCDC
+	write(gb, 0xFF42, 0x00); // SCY
+	write(gb, 0xFF43, 0x00); // SCX
+	write(gb, 0xFF45, 0x00); // LYC
+	write(gb, 0xFF47, 0xFC); // BGP
+	write(gb, 0xFF48, 0xFF); // OBP0
+	write(gb, 0xFF49, 0xFF); // OBP1
+	write(gb, 0xFF4A, 0x00); // WY
+	write(gb, 0xFF4B, 0x00); // WX
+	write(gb, 0xFFFF, 0x00); // IE
 }
@@ -0,0 +1,372 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "failboy.h"
+#include "cpu_alu.h"
+#include <pthread.h>
+
+uint16_t alu_add[2][256][256];
+uint16_t alu_sub[2][256][256];
+uint16_t alu_daa[8][256];
+uint16_t alu_rot[8][2][256];
+uint8_t alu_inc[256];
+uint8_t alu_dec[256];
+
+static pthread_once_t alu_once = PTHREAD_ONCE_INIT;
+
+static uint8_t zero(unsigned n) {
+	return (n & 0xFF) ? 0 : FLAG_Z;
+}
+
+static void alu_fill(void) {
+	for(unsigned c = 0; c < 2; ++c) {
+		for(unsigned a = 0; a < 256; ++a) {
+			for(unsigned n = 0; n < 256; ++n) {
+				unsigned r = a + n + c;
+				uint8_t f = zero(r);
+				if((a & 0xF) + (n & 0xF) + c > 0xF) f |= FLAG_H;
+				if(r > 0xFF) f |= FLAG_C;
+				alu_add[c][a][n] = (r & 0xFF) << 8 | f;
+				
+				r = a - n - c;
+				f = zero(r) | FLAG_N;
+				if((a & 0xF) < (n & 0xF) + c) f |= FLAG_H;
+				if(a < n + c) f |= FLAG_C;
+				alu_sub[c][a][n] = (r & 0xFF) << 8 | f;
+			}
+		}
+	}
+	
+	for(unsigned n = 0; n < 256; ++n) {
+		alu_inc[n] = zero(n) | ((n & 0xF) == 0 ? FLAG_H : 0);
+		alu_dec[n] = zero(n) | FLAG_N | ((n & 0xF) == 0xF ? FLAG_H : 0);
+	}
+	
+	/* same adjust as the old DAA, N is kept and C is only ever set */
+	for(unsigned i = 0; i < 8; ++i) {
+		unsigned fn = i & 4, fh = i & 2, fc = i & 1;
+		for(unsigned a = 0; a < 256; ++a) {
+			int tmp = a;
+			if(fn) {
+				if(fh) {
+					tmp -= 6;
+					if(!fc) tmp &= 0xFF;
+				}
+				if(fc) tmp -= 0x60;
+			} else {
+				if(fh || (tmp & 0xF) > 0x9) tmp += 0x6;
+				if(fc || tmp > 0x9F) tmp += 0x60;
+			}
+			uint8_t f = zero(tmp) | (fn ? FLAG_N : 0) | ((fc || (tmp & 0x100)) ? FLAG_C : 0);
+			alu_daa[i][a] = (tmp & 0xFF) << 8 | f;
+		}
+	}
+	
+	for(unsigned c = 0; c < 2; ++c) {
+		for(unsigned n = 0; n < 256; ++n) {
+			unsigned r[8], out[8];
+			r[ALU_RLC] = (n << 1 | n >> 7) & 0xFF; out[ALU_RLC] = n >> 7;
+			r[ALU_RRC] = (n >> 1 | n << 7) & 0xFF; out[ALU_RRC] = n & 1;
+			r[ALU_RL] = (n << 1 | c) & 0xFF; out[ALU_RL] = n >> 7;
+			r[ALU_RR] = n >> 1 | c << 7; out[ALU_RR] = n & 1;
+			r[ALU_SLA] = (n << 1) & 0xFF; out[ALU_SLA] = n >> 7;
+			r[ALU_SRA] = n >> 1 | (n & 0x80); out[ALU_SRA] = n & 1;
+			r[ALU_SWAP] = (n >> 4 | n << 4) & 0xFF; out[ALU_SWAP] = 0;
+			r[ALU_SRL] = n >> 1; out[ALU_SRL] = n & 1;
+			for(unsigned op = 0; op < 8; ++op) {
+				alu_rot[op][c][n] = r[op] << 8 | zero(r[op]) | (out[op] ? FLAG_C : 0);
+			}
+		}
+	}
+}
+
+/* Fills the tables the first time it is called, safe from any thread. */
+void alu_init() {
+	pthread_once(&alu_once, alu_fill);
+}
+
+/* **************************************** */
+/*
+ * The per-op code the tables replace, moved here from cpu_alu.h as it was
+ * apart from the ref_ prefix. Only the self test uses it.
+ */
+static void ref_ADD(struct registers *reg, uint8_t n) {
+	reg->F = 0;
+	reg->F_N = 0;
+	reg->F_H = (reg->A & 0xF) + (n & 0xF) > 0xF;
+	reg->F_C = (reg->A + n) > 0xFF;
+	reg->A += n;
+	reg->F_Z = !reg->A;
+}
+
+/* The carry goes in after the operand, so n = 0xFF with carry still carries. */
+static void ref_ADC(struct registers *reg, uint8_t n) {
+	uint8_t c = reg->F_C;
+	reg->F = 0;
+	reg->F_H = (reg->A & 0xF) + (n & 0xF) + c > 0xF;
+	reg->F_C = reg->A + n + c > 0xFF;
+	reg->A += n + c;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_SUB(struct registers *reg, uint8_t n) {
+	reg->F = 0;
+	reg->F_N = 1;
+	reg->F_H = (reg->A & 0xF) < (n & 0xF);
+	reg->F_C = reg->A < n;
+	reg->A -= n;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_SBC(struct registers *reg, uint8_t n) {
+	uint8_t c = reg->F_C;
+	reg->F = 0;
+	reg->F_N = 1;
+	reg->F_H = (reg->A & 0xF) < (n & 0xF) + c;
+	reg->F_C = reg->A < n + c;
+	reg->A -= n + c;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_AND(struct registers *reg, uint8_t n) {
+	reg->A &= n;
+	reg->F = 0;
+	reg->F_H = 1;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_OR(struct registers *reg, uint8_t n) {
+	reg->A |= n;
+	reg->F = 0;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_XOR(struct registers *reg, uint8_t n) {
+	reg->A ^= n;
+	reg->F = 0;
+	reg->F_Z = !reg->A;
+}
+
+static void ref_CP(struct registers *reg, uint8_t n) {
+	reg->F = 0;
+	reg->F_N = 1;
+	reg->F_H = (reg->A & 0xF) < (n & 0xF);
+	reg->F_C = reg->A < n;
+	reg->F_Z = reg->A == n;
+}
+
+/* INC and DEC take the already updated value. */
+static void ref_INC(struct registers *reg, uint8_t n) {
+	reg->F_N = 0;
+	reg->F_H = !(n & 0xf);
+	reg->F_Z = !n;
+}
+
+static void ref_DEC(struct registers *reg, uint8_t n) {
+	reg->F_N = 1;
+	reg->F_H = (n & 0xf) == 0xf;
+	reg->F_Z = !n;
+}
+
+static void ref_DAA_r(struct registers *reg) {
+	/* //sigh// let's get this shit over with */
+	register int32_t tmp = reg->A;
+	
+	if(reg->F_N) {
+		if(reg->F_H) {
+			tmp -= 6;
+			if(!reg->F_C) {
+				tmp &= 0xFF;
+			}
+		}
+		if(reg->F_C) {
+			tmp -= 0x60;
+		}
+	} else {
+		if(reg->F_H || (tmp & 0xF) > 0x9) {
+			tmp += 0x6;
+		}
+		if(reg->F_C || tmp > 0x9F) {
+			tmp += 0x60;
+		}
+	}
+	
+	reg->F_H = 0;
+	if(tmp & 0x100)
+		reg->F_C = 1;
+	reg->A = tmp & 0xFF;
+	reg->F_Z = !reg->A;
+}
+
+static uint8_t ref_SWAP(struct registers *reg, uint8_t n) {
+	reg->F = 0;
+	reg->F_Z = n == 0;
+	return (n >> 4) | (n << 4);
+}
+
+static uint8_t ref_RLC_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = (n >> 7) & 1;
+	n = (n << 1) | bit;
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_RL_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = (n >> 7) & 1;
+	n = (n << 1) | reg->F_C;
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_RRC_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = n & 1;
+	n = (n >> 1) | (bit << 7);
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_RR_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = n & 1;
+	n = (n >> 1) | (reg->F_C << 7);
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_SLA_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = (n >> 7) & 1;
+	n <<= 1;
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_SRA_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = n & 1;
+	n = (n >> 1) | (n & 0x80);
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static uint8_t ref_SRL_n(struct registers *reg, register uint8_t n) {
+	register uint8_t bit = n & 1;
+	n >>= 1;
+	reg->F = 0;
+	reg->F_C = bit;
+	reg->F_Z = !n;
+	return n;
+}
+
+static unsigned alu_check(FILE *out, const char *op, uint8_t a, uint8_t n, uint8_t f,
+		const struct registers *got, const struct registers *want) {
+	if(got->A == want->A && got->F == want->F) {
+		return 0;
+	}
+	fprintf(out, "%s A=%02X n=%02X F=%02X: got A=%02X F=%02X, want A=%02X F=%02X\n",
+		op, a, n, f, got->A, got->F, want->A, want->F);
+	return 1;
+}
+
+/* Runs every input through the tables and the old per-op code, prints any
+ * mismatch and returns how many there were. */
+unsigned alu_selftest(FILE *out) {
+	static const char *const rot_names[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+	static const char *const rot_a_names[4] = { "RLCA", "RRCA", "RLA", "RRA" };
+	static uint8_t (*const ref_rot[8])(struct registers *, uint8_t) = {
+		ref_RLC_n, ref_RRC_n, ref_RL_n, ref_RR_n, ref_SLA_n, ref_SRA_n, ref_SWAP, ref_SRL_n
+	};
+	unsigned bad = 0;
+	
+	alu_init();
+	for(unsigned f = 0; f < 0x100; f += 0x10) {
+		for(unsigned a = 0; a < 256; ++a) {
+			struct registers in = { 0 };
+			struct registers got, want;
+			in.A = a;
+			in.F = f;
+			
+			for(unsigned n = 0; n < 256; ++n) {
+				got = in; want = in;
+				ADD(&got, n); ref_ADD(&want, n);
+				bad += alu_check(out, "ADD", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				ADC(&got, n); ref_ADC(&want, n);
+				bad += alu_check(out, "ADC", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				SUB(&got, n); ref_SUB(&want, n);
+				bad += alu_check(out, "SUB", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				SBC(&got, n); ref_SBC(&want, n);
+				bad += alu_check(out, "SBC", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				AND(&got, n); ref_AND(&want, n);
+				bad += alu_check(out, "AND", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				OR(&got, n); ref_OR(&want, n);
+				bad += alu_check(out, "OR", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				XOR(&got, n); ref_XOR(&want, n);
+				bad += alu_check(out, "XOR", a, n, f, &got, &want);
+				
+				got = in; want = in;
+				CP(&got, n); ref_CP(&want, n);
+				bad += alu_check(out, "CP", a, n, f, &got, &want);
+			}
+			
+			got = in; want = in;
+			INC(&got, a); ref_INC(&want, a);
+			bad += alu_check(out, "INC", a, 0, f, &got, &want);
+			
+			got = in; want = in;
+			DEC(&got, a); ref_DEC(&want, a);
+			bad += alu_check(out, "DEC", a, 0, f, &got, &want);
+			
+			got = in; want = in;
+			DAA_r(&got); ref_DAA_r(&want);
+			bad += alu_check(out, "DAA", a, 0, f, &got, &want);
+			
+			for(unsigned op = 0; op < 8; ++op) {
+				got = in; want = in;
+				got.A = ROT(&got, op, a); want.A = ref_rot[op](&want, a);
+				bad += alu_check(out, rot_names[op], a, 0, f, &got, &want);
+				
+				/* the handlers ran the CB helper and cleared Z after it */
+				if(op < ALU_SLA) {
+					got = in; want = in;
+					ROT_A(&got, op); want.A = ref_rot[op](&want, a); want.F_Z = 0;
+					bad += alu_check(out, rot_a_names[op], a, 0, f, &got, &want);
+				}
+			}
+		}
+	}
+	fprintf(out, "alu: %u mismatches\n", bad);
+	return bad;
+}
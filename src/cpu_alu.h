@@ -0,0 +1,145 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CPU_ALU_H_
+#define _CPU_ALU_H_
+
+#include "failboy.h"
+
+/*
+ * ALU operations shared by the interpreter cores. They take the register file
+ * they work on so the switch core can keep its own copy in locals.
+ */
+
+/* F register bits */
+#define FLAG_Z 0x80
+#define FLAG_N 0x40
+#define FLAG_H 0x20
+#define FLAG_C 0x10
+
+/* Rows of alu_rot, in the same order as the CB opcode rows. */
+enum {
+	ALU_RLC, ALU_RRC, ALU_RL, ALU_RR, ALU_SLA, ALU_SRA, ALU_SWAP, ALU_SRL
+};
+
+/*
+ * Result and flag tables, filled by alu_init() in cpu_alu.c. The 16 bit
+ * entries hold the result in the high byte and the complete F byte in the
+ * low byte, which is the layout of AF.
+ */
+extern uint16_t alu_add[2][256][256];	/* [carry in][A][n] */
+extern uint16_t alu_sub[2][256][256];	/* [carry in][A][n] */
+extern uint16_t alu_daa[8][256];	/* [N H C][A] */
+extern uint16_t alu_rot[8][2][256];	/* [ALU_*][carry in][n] */
+extern uint8_t alu_inc[256];	/* [result], F without C */
+extern uint8_t alu_dec[256];	/* [result], F without C */
+
+/* **************************************** */
+/* 8-bit Arithmetic (ALU8) */
+static inline void ADD(struct registers *reg, uint8_t n) {
+	reg->AF = alu_add[0][reg->A][n];
+}
+
+static inline void ADC(struct registers *reg, uint8_t n) {
+	reg->AF = alu_add[reg->F_C][reg->A][n];
+}
+
+static inline void SUB(struct registers *reg, uint8_t n) {
+	reg->AF = alu_sub[0][reg->A][n];
+}
+
+static inline void SBC(struct registers *reg, uint8_t n) {
+	reg->AF = alu_sub[reg->F_C][reg->A][n];
+}
+
+static inline void AND(struct registers *reg, uint8_t n) {
+	reg->A &= n;
+	reg->F = reg->A ? FLAG_H : FLAG_Z | FLAG_H;
+}
+
+static inline void OR(struct registers *reg, uint8_t n) {
+	reg->A |= n;
+	reg->F = reg->A ? 0 : FLAG_Z;
+}
+
+static inline void XOR(struct registers *reg, uint8_t n) {
+	reg->A ^= n;
+	reg->F = reg->A ? 0 : FLAG_Z;
+}
+
+static inline void CP(struct registers *reg, uint8_t n) {
+	reg->F = (uint8_t)alu_sub[0][reg->A][n];
+}
+
+/* INC and DEC take the already updated value. */
+static inline void INC(struct registers *reg, uint8_t n) {
+	reg->F = (reg->F & FLAG_C) | alu_inc[n];
+}
+
+static inline void DEC(struct registers *reg, uint8_t n) {
+	reg->F = (reg->F & FLAG_C) | alu_dec[n];
+}
+
+static inline void DAA_r(struct registers *reg) {
+	reg->AF = alu_daa[(reg->F >> 4) & 7][reg->A];
+}
+
+/* **************************************** */
+/* 16-bit Arithmetic (ALU16) */
+static inline void ADD_HL(struct registers *reg, uint16_t n) {
+	reg->F_N = 0;
+	reg->F_H = (reg->HL & 0xFFF) + (n & 0xFFF) > 0xFFF;
+	reg->F_C = (reg->HL + n) > 0xFFFF;
+	reg->HL = reg->HL + n;
+}
+
+/* SP + signed n, used by ADD SP,n and LDHL SP,n */
+static inline uint16_t SP_n(struct registers *reg, int8_t n) {
+	reg->F = 0;
+	reg->F_H = (reg->SP & 0xF) + (n & 0xf) > 0xF;
+	reg->F_C = (reg->SP & 0xFF) + (n & 0xfF) > 0xFF;
+	return (uint16_t)(reg->SP + n);
+}
+
+/* **************************************** */
+/* Rotates & Shifts */
+static inline uint8_t ROT(struct registers *reg, unsigned op, uint8_t n) {
+	uint16_t v = alu_rot[op][reg->F_C][n];
+	reg->F = (uint8_t)v;
+	return v >> 8;
+}
+
+/* RLCA, RLA, RRCA and RRA always clear Z. */
+static inline void ROT_A(struct registers *reg, unsigned op) {
+	uint16_t v = alu_rot[op][reg->F_C][reg->A];
+	reg->AF = v & ~FLAG_Z;
+}
+
+#define SWAP(reg, n) ROT((reg), ALU_SWAP, (n))
+#define RLC_n(reg, n) ROT((reg), ALU_RLC, (n))
+#define RL_n(reg, n) ROT((reg), ALU_RL, (n))
+#define RRC_n(reg, n) ROT((reg), ALU_RRC, (n))
+#define RR_n(reg, n) ROT((reg), ALU_RR, (n))
+#define SLA_n(reg, n) ROT((reg), ALU_SLA, (n))
+#define SRA_n(reg, n) ROT((reg), ALU_SRA, (n))
+#define SRL_n(reg, n) ROT((reg), ALU_SRL, (n))
+
+static inline void BIT_b_r(struct registers *reg, register uint8_t b, register uint8_t x) {
+	reg->F_Z = !(x & (1 << b));
+	reg->F_N = 0;
+	reg->F_H = 1;
+}
+
+#endif /* _CPU_ALU_H_ */
@@ -14,552 +14,452 @@
  */
 
 #include "failboy.h"
+#include "cpu_alu.h"
+#include "cpu_instr.h"
+#include "cpu_instr_fuse.h"
 
 /* **************************************** */
 /* 8-bit loads */
-void LD_A_n() { r.A = rpc8(); }
-void LD_B_n() { r.B = rpc8(); }
-void LD_C_n() { r.C = rpc8(); }
-void LD_D_n() { r.D = rpc8(); }
-void LD_E_n() { r.E = rpc8(); }
-void LD_H_n() { r.H = rpc8(); }
-void LD_L_n() { r.L = rpc8(); }
-void LD_aHL_n() { write(r.HL, rpc8()); }
-
-void LD_A_A() { r.A = r.A; }
-void LD_A_B() { r.A = r.B; }
-void LD_A_C() { r.A = r.C; }
-void LD_A_D() { r.A = r.D; }
-void LD_A_E() { r.A = r.E; }
-void LD_A_H() { r.A = r.H; }
-void LD_A_L() { r.A = r.L; }
-void LD_A_aHL() { r.A = read(r.HL); }
-
-void LD_A_aC() { r.A = read(r.C + 0xFF00); }
-void LD_aC_A() { write(r.C + 0xFF00, r.A); }
-
-void LD_A_aBC() { r.A = read(r.BC); }
-void LD_A_aDE() { r.A = read(r.DE); }
-void LD_A_ann() { r.A = read(rpc16()); }
-
-void LD_B_A() { r.B = r.A; }
-void LD_B_B() { r.B = r.B; }
-void LD_B_C() { r.B = r.C; }
-void LD_B_D() { r.B = r.D; }
-void LD_B_E() { r.B = r.E; }
-void LD_B_H() { r.B = r.H; }
-void LD_B_L() { r.B = r.L; }
-void LD_B_aHL() { r.B = read(r.HL); }
-
-void LD_C_A() { r.C = r.A; }
-void LD_C_B() { r.C = r.B; }
-void LD_C_C() { r.C = r.C; }
-void LD_C_D() { r.C = r.D; }
-void LD_C_E() { r.C = r.E; }
-void LD_C_H() { r.C = r.H; }
-void LD_C_L() { r.C = r.L; }
-void LD_C_aHL() { r.C = read(r.HL); }
-
-void LD_D_A() { r.D = r.A; }
-void LD_D_B() { r.D = r.B; }
-void LD_D_C() { r.D = r.C; }
-void LD_D_D() { r.D = r.D; }
-void LD_D_E() { r.D = r.E; }
-void LD_D_H() { r.D = r.H; }
-void LD_D_L() { r.D = r.L; }
-void LD_D_aHL() { r.D = read(r.HL); }
-
-void LD_E_A() { r.E = r.A; }
-void LD_E_B() { r.E = r.B; }
-void LD_E_C() { r.E = r.C; }
-void LD_E_D() { r.E = r.D; }
-void LD_E_E() { r.E = r.E; }
-void LD_E_H() { r.E = r.H; }
-void LD_E_L() { r.E = r.L; }
-void LD_E_aHL() { r.E = read(r.HL); }
-
-void LD_H_A() { r.H = r.A; }
-void LD_H_B() { r.H = r.B; }
-void LD_H_C() { r.H = r.C; }
-void LD_H_D() { r.H = r.D; }
-void LD_H_E() { r.H = r.E; }
-void LD_H_H() { r.H = r.H; }
-void LD_H_L() { r.H = r.L; }
-void LD_H_aHL() { r.H = read(r.HL); }
-
-void LD_L_A() { r.L = r.A; }
-void LD_L_B() { r.L = r.B; }
-void LD_L_C() { r.L = r.C; }
-void LD_L_D() { r.L = r.D; }
-void LD_L_E() { r.L = r.E; }
-void LD_L_H() { r.L = r.H; }
-void LD_L_L() { r.L = r.L; }
-void LD_L_aHL() { r.L = read(r.HL); }
-
-void LD_aHL_A() { write(r.HL, r.A); }
-void LD_aHL_B() { write(r.HL, r.B); }
-void LD_aHL_C() { write(r.HL, r.C); }
-void LD_aHL_D() { write(r.HL, r.D); }
-void LD_aHL_E() { write(r.HL, r.E); }
-void LD_aHL_H() { write(r.HL, r.H); }
-void LD_aHL_L() { write(r.HL, r.L); }
-
-void LD_aBC_A() { write(r.BC, r.A); }
-void LD_aDE_A() { write(r.DE, r.A); }
-void LD_ann_A() { write(rpc16(), r.A); }
-
-void LDD_A_aHL() { r.A = read(r.HL--); }
-void LDD_aHL_A() { write(r.HL--, r.A); }
-
-void LDI_A_aHL() { r.A = read(r.HL++); }
-void LDI_aHL_A() { write(r.HL++, r.A); }
-
-void LDH_A_an() { r.A = read(0xFF00 + rpc8()); }
-void LDH_an_A() { write(0xFF00 + rpc8(), r.A); }
+void LD_A_n(struct gb *gb) { gb->r.A = rpc8(gb); }
+void LD_B_n(struct gb *gb) { gb->r.B = rpc8(gb); }
+void LD_C_n(struct gb *gb) { gb->r.C = rpc8(gb); }
+void LD_D_n(struct gb *gb) { gb->r.D = rpc8(gb); }
+void LD_E_n(struct gb *gb) { gb->r.E = rpc8(gb); }
+void LD_H_n(struct gb *gb) { gb->r.H = rpc8(gb); }
+void LD_L_n(struct gb *gb) { gb->r.L = rpc8(gb); }
+void LD_aHL_n(struct gb *gb) { write(gb, gb->r.HL, rpc8(gb)); }
+
+void LD_A_A(struct gb *gb) { gb->r.A = gb->r.A; }
+void LD_A_B(struct gb *gb) { gb->r.A = gb->r.B; }
+void LD_A_C(struct gb *gb) { gb->r.A = gb->r.C; }
+void LD_A_D(struct gb *gb) { gb->r.A = gb->r.D; }
+void LD_A_E(struct gb *gb) { gb->r.A = gb->r.E; }
+void LD_A_H(struct gb *gb) { gb->r.A = gb->r.H; }
+void LD_A_L(struct gb *gb) { gb->r.A = gb->r.L; }
+void LD_A_aHL(struct gb *gb) { gb->r.A = read(gb, gb->r.HL); }
+
+void LD_A_aC(struct gb *gb) { gb->r.A = read(gb, gb->r.C + 0xFF00); }
+void LD_aC_A(struct gb *gb) { write(gb, gb->r.C + 0xFF00, gb->r.A); }
+
+void LD_A_aBC(struct gb *gb) { gb->r.A = read(gb, gb->r.BC); }
+void LD_A_aDE(struct gb *gb) { gb->r.A = read(gb, gb->r.DE); }
+void LD_A_ann(struct gb *gb) { gb->r.A = read(gb, rpc16(gb)); }
+
+void LD_B_A(struct gb *gb) { gb->r.B = gb->r.A; }
+/* LD B,B doubles as the mooneye breakpoint */
+void LD_B_B(struct gb *gb) {
+	if(gb->stop_ldbb) {
+		cpu_ldbb(gb);
+	}
+}
+void LD_B_C(struct gb *gb) { gb->r.B = gb->r.C; }
+void LD_B_D(struct gb *gb) { gb->r.B = gb->r.D; }
+void LD_B_E(struct gb *gb) { gb->r.B = gb->r.E; }
+void LD_B_H(struct gb *gb) { gb->r.B = gb->r.H; }
+void LD_B_L(struct gb *gb) { gb->r.B = gb->r.L; }
+void LD_B_aHL(struct gb *gb) { gb->r.B = read(gb, gb->r.HL); }
+
+void LD_C_A(struct gb *gb) { gb->r.C = gb->r.A; }
+void LD_C_B(struct gb *gb) { gb->r.C = gb->r.B; }
+void LD_C_C(struct gb *gb) { gb->r.C = gb->r.C; }
+void LD_C_D(struct gb *gb) { gb->r.C = gb->r.D; }
+void LD_C_E(struct gb *gb) { gb->r.C = gb->r.E; }
+void LD_C_H(struct gb *gb) { gb->r.C = gb->r.H; }
+void LD_C_L(struct gb *gb) { gb->r.C = gb->r.L; }
+void LD_C_aHL(struct gb *gb) { gb->r.C = read(gb, gb->r.HL); }
+
+void LD_D_A(struct gb *gb) { gb->r.D = gb->r.A; }
+void LD_D_B(struct gb *gb) { gb->r.D = gb->r.B; }
+void LD_D_C(struct gb *gb) { gb->r.D = gb->r.C; }
+void LD_D_D(struct gb *gb) { gb->r.D = gb->r.D; }
+void LD_D_E(struct gb *gb) { gb->r.D = gb->r.E; }
+void LD_D_H(struct gb *gb) { gb->r.D = gb->r.H; }
+void LD_D_L(struct gb *gb) { gb->r.D = gb->r.L; }
+void LD_D_aHL(struct gb *gb) { gb->r.D = read(gb, gb->r.HL); }
+
+void LD_E_A(struct gb *gb) { gb->r.E = gb->r.A; }
+void LD_E_B(struct gb *gb) { gb->r.E = gb->r.B; }
+void LD_E_C(struct gb *gb) { gb->r.E = gb->r.C; }
+void LD_E_D(struct gb *gb) { gb->r.E = gb->r.D; }
+void LD_E_E(struct gb *gb) { gb->r.E = gb->r.E; }
+void LD_E_H(struct gb *gb) { gb->r.E = gb->r.H; }
+void LD_E_L(struct gb *gb) { gb->r.E = gb->r.L; }
+void LD_E_aHL(struct gb *gb) { gb->r.E = read(gb, gb->r.HL); }
+
+void LD_H_A(struct gb *gb) { gb->r.H = gb->r.A; }
+void LD_H_B(struct gb *gb) { gb->r.H = gb->r.B; }
+void LD_H_C(struct gb *gb) { gb->r.H = gb->r.C; }
+void LD_H_D(struct gb *gb) { gb->r.H = gb->r.D; }
+void LD_H_E(struct gb *gb) { gb->r.H = gb->r.E; }
+void LD_H_H(struct gb *gb) { gb->r.H = gb->r.H; }
+void LD_H_L(struct gb *gb) { gb->r.H = gb->r.L; }
+void LD_H_aHL(struct gb *gb) { gb->r.H = read(gb, gb->r.HL); }
+
+void LD_L_A(struct gb *gb) { gb->r.L = gb->r.A; }
+void LD_L_B(struct gb *gb) { gb->r.L = gb->r.B; }
+void LD_L_C(struct gb *gb) { gb->r.L = gb->r.C; }
+void LD_L_D(struct gb *gb) { gb->r.L = gb->r.D; }
+void LD_L_E(struct gb *gb) { gb->r.L = gb->r.E; }
+void LD_L_H(struct gb *gb) { gb->r.L = gb->r.H; }
+void LD_L_L(struct gb *gb) { gb->r.L = gb->r.L; }
+void LD_L_aHL(struct gb *gb) { gb->r.L = read(gb, gb->r.HL); }
+
+void LD_aHL_A(struct gb *gb) { write(gb, gb->r.HL, gb->r.A); }
+void LD_aHL_B(struct gb *gb) { write(gb, gb->r.HL, gb->r.B); }
+void LD_aHL_C(struct gb *gb) { write(gb, gb->r.HL, gb->r.C); }
+void LD_aHL_D(struct gb *gb) { write(gb, gb->r.HL, gb->r.D); }
+void LD_aHL_E(struct gb *gb) { write(gb, gb->r.HL, gb->r.E); }
+void LD_aHL_H(struct gb *gb) { write(gb, gb->r.HL, gb->r.H); }
+void LD_aHL_L(struct gb *gb) { write(gb, gb->r.HL, gb->r.L); }
+
+void LD_aBC_A(struct gb *gb) { write(gb, gb->r.BC, gb->r.A); }
+void LD_aDE_A(struct gb *gb) { write(gb, gb->r.DE, gb->r.A); }
+void LD_ann_A(struct gb *gb) { write(gb, rpc16(gb), gb->r.A); }
+
+void LDD_A_aHL(struct gb *gb) { gb->r.A = read(gb, gb->r.HL--); }
+void LDD_aHL_A(struct gb *gb) { write(gb, gb->r.HL--, gb->r.A); }
+
+void LDI_A_aHL(struct gb *gb) { gb->r.A = read(gb, gb->r.HL++); }
+void LDI_aHL_A(struct gb *gb) { write(gb, gb->r.HL++, gb->r.A); }
+
+void LDH_A_an(struct gb *gb) { gb->r.A = read(gb, 0xFF00 + rpc8(gb)); }
+void LDH_an_A(struct gb *gb) { write(gb, 0xFF00 + rpc8(gb), gb->r.A); }
 
 
 /* **************************************** */
 /* 16-bit loads */
 
-void LD_BC_nn() { r.BC = rpc16(); }
-void LD_DE_nn() { r.DE = rpc16(); }
-void LD_HL_nn() { r.HL = rpc16(); }
-void LD_SP_nn() { r.SP = rpc16(); }
+void LD_BC_nn(struct gb *gb) { gb->r.BC = rpc16(gb); }
+void LD_DE_nn(struct gb *gb) { gb->r.DE = rpc16(gb); }
+void LD_HL_nn(struct gb *gb) { gb->r.HL = rpc16(gb); }
+void LD_SP_nn(struct gb *gb) { gb->r.SP = rpc16(gb); }
 
-void LD_SP_HL() { r.SP = r.HL; }
+void LD_SP_HL(struct gb *gb) { gb->r.SP = gb->r.HL; }
 
-void LDHL_SP_n() {
-	register int8_t n = rpc8();
-	r.F = 0;
-	r.F_H = (r.SP & 0xF) + (n & 0xf) > 0xF;
-	r.F_C = (r.SP & 0xFF) + (n & 0xfF) > 0xFF;
-	r.HL = (uint16_t)(r.SP + n);
-}
+void LDHL_SP_n(struct gb *gb) { gb->r.HL = SP_n(&gb->r, rpc8(gb)); }
 
-void LD_ann_SP() { write16(rpc16(), r.SP); }
+void LD_ann_SP(struct gb *gb) { write16(gb, rpc16(gb), gb->r.SP); }
 
-static inline void PUSH16(uint16_t n) {
-	r.SP -= 2;
-	write16(r.SP, n);
+static inline void PUSH16(struct gb *gb, uint16_t n) {
+	gb->r.SP -= 2;
+	write16(gb, gb->r.SP, n);
 }
-void PUSH_AF() { PUSH16(r.AF); }
-void PUSH_BC() { PUSH16(r.BC); }
-void PUSH_DE() { PUSH16(r.DE); }
-void PUSH_HL() { PUSH16(r.HL); }
-
-static inline uint16_t POP16() {
-	uint16_t ret = read16(r.SP);
-	r.SP += 2;
+void PUSH_AF(struct gb *gb) { PUSH16(gb, gb->r.AF); }
+void PUSH_BC(struct gb *gb) { PUSH16(gb, gb->r.BC); }
+void PUSH_DE(struct gb *gb) { PUSH16(gb, gb->r.DE); }
+void PUSH_HL(struct gb *gb) { PUSH16(gb, gb->r.HL); }
+
+static inline uint16_t POP16(struct gb *gb) {
+	uint16_t ret = read16(gb, gb->r.SP);
+	gb->r.SP += 2;
 	return ret;
 }
 
 /* Lower bits of F are never ever set. */
-void POP_AF() { r.AF = POP16() & 0xFFF0; }
-void POP_BC() { r.BC = POP16(); }
-void POP_DE() { r.DE = POP16(); }
-void POP_HL() { r.HL = POP16(); }
+void POP_AF(struct gb *gb) { gb->r.AF = POP16(gb) & 0xFFF0; }
+void POP_BC(struct gb *gb) { gb->r.BC = POP16(gb); }
+void POP_DE(struct gb *gb) { gb->r.DE = POP16(gb); }
+void POP_HL(struct gb *gb) { gb->r.HL = POP16(gb); }
 
 /* **************************************** */
 /* 8-bit Arithmetic (ALU8) */
 
-static inline void ADD(uint8_t n) {
-	r.F = 0;
-	r.F_N = 0;
-	r.F_H = (r.A & 0xF) + (n & 0xF) > 0xF;
-	r.F_C = (r.A + n) > 0xFF;
-	r.A += n;
-	r.F_Z = !r.A;
-}
-void ADD_A_A() { ADD(r.A); }
-void ADD_A_B() { ADD(r.B); }
-void ADD_A_C() { ADD(r.C); }
-void ADD_A_D() { ADD(r.D); }
-void ADD_A_E() { ADD(r.E); }
-void ADD_A_H() { ADD(r.H); }
-void ADD_A_L() { ADD(r.L); }
-void ADD_A_aHL() { ADD(read(r.HL)); }
-void ADD_A_n() { ADD(rpc8()); }
-
-void ADC_A_A() { ADD(r.A + r.F_C); }
-void ADC_A_B() { ADD(r.B + r.F_C); }
-void ADC_A_C() { ADD(r.C + r.F_C); }
-void ADC_A_D() { ADD(r.D + r.F_C); }
-void ADC_A_E() { ADD(r.E + r.F_C); }
-void ADC_A_H() { ADD(r.H + r.F_C); }
-void ADC_A_L() { ADD(r.L + r.F_C); }
-void ADC_A_aHL() { ADD(read(r.HL) + r.F_C); }
-void ADC_A_n() { ADD(rpc8() + r.F_C); }
-
-static inline void SUB(uint8_t n) {
-	r.F = 0;
-	r.F_N = 1;
-	r.F_H = (r.A & 0xF) < (n & 0xF);
-	r.F_C = r.A < n;
-	r.A -= n;
-	r.F_Z = !r.A;
-}
-
-void SUB_A() { SUB(r.A); }
-void SUB_B() { SUB(r.B); }
-void SUB_C() { SUB(r.C); }
-void SUB_D() { SUB(r.D); }
-void SUB_E() { SUB(r.E); }
-void SUB_H() { SUB(r.H); }
-void SUB_L() { SUB(r.L); }
-void SUB_aHL() { SUB(read(r.HL)); }
-void SUB_n() { SUB(rpc8()); }
-
-void SBC_A_A() { SUB(r.A + r.F_C); }
-void SBC_A_B() { SUB(r.B + r.F_C); }
-void SBC_A_C() { SUB(r.C + r.F_C); }
-void SBC_A_D() { SUB(r.D + r.F_C); }
-void SBC_A_E() { SUB(r.E + r.F_C); }
-void SBC_A_H() { SUB(r.H + r.F_C); }
-void SBC_A_L() { SUB(r.L + r.F_C); }
-void SBC_A_aHL() { SUB(read(r.HL) + r.F_C); }
-void SBC_A_n() { SUB(rpc8() + r.F_C); }
-
-static inline void AND(uint8_t n) {
-	r.A &= n;
-	r.F = 0;
-	r.F_H = 1;
-	r.F_Z = !r.A;
-}
-void AND_A() { AND(r.A); }
-void AND_B() { AND(r.B); }
-void AND_C() { AND(r.C); }
-void AND_D() { AND(r.D); }
-void AND_E() { AND(r.E); }
-void AND_H() { AND(r.H); }
-void AND_L() { AND(r.L); }
-void AND_aHL() { AND(read(r.HL)); }
-void AND_n() { AND(rpc8()); }
-
-static inline void OR(uint8_t n) {
-	r.A |= n;
-	r.F = 0;
-	r.F_Z = !r.A;
-}
-void OR_A() { OR(r.A); }
-void OR_B() { OR(r.B); }
-void OR_C() { OR(r.C); }
-void OR_D() { OR(r.D); }
-void OR_E() { OR(r.E); }
-void OR_H() { OR(r.H); }
-void OR_L() { OR(r.L); }
-void OR_aHL() { OR(read(r.HL)); }
-void OR_n() { OR(rpc8()); }
-
-static inline void XOR(uint8_t n) {
-	r.A |= n;
-	r.F = 0;
-	r.F_Z = !r.A;
-}
-void XOR_A() { XOR(r.A); }
-void XOR_B() { XOR(r.B); }
-void XOR_C() { XOR(r.C); }
-void XOR_D() { XOR(r.D); }
-void XOR_E() { XOR(r.E); }
-void XOR_H() { XOR(r.H); }
-void XOR_L() { XOR(r.L); }
-void XOR_aHL() { XOR(read(r.HL)); }
-void XOR_n() { XOR(rpc8()); }
-
-static inline void CP(uint8_t n) {
-	r.F = 0;
-	r.F_N = 1;
-	r.F_H = (r.A & 0xF) < (n & 0xF);
-	r.F_C = r.A < n;
-	r.F_Z = r.A == n;
-}
-void CP_A() { CP(r.A); }
-void CP_B() { CP(r.B); }
-void CP_C() { CP(r.C); }
-void CP_D() { CP(r.D); }
-void CP_E() { CP(r.E); }
-void CP_H() { CP(r.H); }
-void CP_L() { CP(r.L); }
-void CP_aHL() { CP(read(r.HL)); }
-void CP_n() { CP(rpc8()); }
-
-static inline void INC(uint8_t n) {
-	r.F_N = 0;
-	r.F_H = !(n & 0xf);
-	r.F_Z = !n;
-}
-void INC_A() { INC(++r.A); }
-void INC_B() { INC(++r.B); }
-void INC_C() { INC(++r.C); }
-void INC_D() { INC(++r.D); }
-void INC_E() { INC(++r.E); }
-void INC_H() { INC(++r.H); }
-void INC_L() { INC(++r.L); }
-void INC_aHL() {
-	register uint8_t tmp = read(r.HL) + 1;
-	write(r.HL, tmp);
-	INC(tmp);
-}
-
-static inline void DEC(uint8_t n) {
-	r.F_N = 1;
-	r.F_H = (n & 0xf) == 0xf;
-	r.F_Z = !n;
-}
-void DEC_A() { DEC(--r.A); }
-void DEC_B() { DEC(--r.B); }
-void DEC_C() { DEC(--r.C); }
-void DEC_D() { DEC(--r.D); }
-void DEC_E() { DEC(--r.E); }
-void DEC_H() { DEC(--r.H); }
-void DEC_L() { DEC(--r.L); }
-void DEC_aHL() {
-	register uint8_t tmp = read(r.HL) - 1;
-	write(r.HL, tmp);
-	DEC(tmp);
+void ADD_A_A(struct gb *gb) { ADD(&gb->r, gb->r.A); }
+void ADD_A_B(struct gb *gb) { ADD(&gb->r, gb->r.B); }
+void ADD_A_C(struct gb *gb) { ADD(&gb->r, gb->r.C); }
+void ADD_A_D(struct gb *gb) { ADD(&gb->r, gb->r.D); }
+void ADD_A_E(struct gb *gb) { ADD(&gb->r, gb->r.E); }
+void ADD_A_H(struct gb *gb) { ADD(&gb->r, gb->r.H); }
+void ADD_A_L(struct gb *gb) { ADD(&gb->r, gb->r.L); }
+void ADD_A_aHL(struct gb *gb) { ADD(&gb->r, read(gb, gb->r.HL)); }
+void ADD_A_n(struct gb *gb) { ADD(&gb->r, rpc8(gb)); }
+
+void ADC_A_A(struct gb *gb) { ADC(&gb->r, gb->r.A); }
+void ADC_A_B(struct gb *gb) { ADC(&gb->r, gb->r.B); }
+void ADC_A_C(struct gb *gb) { ADC(&gb->r, gb->r.C); }
+void ADC_A_D(struct gb *gb) { ADC(&gb->r, gb->r.D); }
+void ADC_A_E(struct gb *gb) { ADC(&gb->r, gb->r.E); }
+void ADC_A_H(struct gb *gb) { ADC(&gb->r, gb->r.H); }
+void ADC_A_L(struct gb *gb) { ADC(&gb->r, gb->r.L); }
+void ADC_A_aHL(struct gb *gb) { ADC(&gb->r, read(gb, gb->r.HL)); }
+void ADC_A_n(struct gb *gb) { ADC(&gb->r, rpc8(gb)); }
+
+void SUB_A(struct gb *gb) { SUB(&gb->r, gb->r.A); }
+void SUB_B(struct gb *gb) { SUB(&gb->r, gb->r.B); }
+void SUB_C(struct gb *gb) { SUB(&gb->r, gb->r.C); }
+void SUB_D(struct gb *gb) { SUB(&gb->r, gb->r.D); }
+void SUB_E(struct gb *gb) { SUB(&gb->r, gb->r.E); }
+void SUB_H(struct gb *gb) { SUB(&gb->r, gb->r.H); }
+void SUB_L(struct gb *gb) { SUB(&gb->r, gb->r.L); }
+void SUB_aHL(struct gb *gb) { SUB(&gb->r, read(gb, gb->r.HL)); }
+void SUB_n(struct gb *gb) { SUB(&gb->r, rpc8(gb)); }
+
+void SBC_A_A(struct gb *gb) { SBC(&gb->r, gb->r.A); }
+void SBC_A_B(struct gb *gb) { SBC(&gb->r, gb->r.B); }
+void SBC_A_C(struct gb *gb) { SBC(&gb->r, gb->r.C); }
+void SBC_A_D(struct gb *gb) { SBC(&gb->r, gb->r.D); }
+void SBC_A_E(struct gb *gb) { SBC(&gb->r, gb->r.E); }
+void SBC_A_H(struct gb *gb) { SBC(&gb->r, gb->r.H); }
+void SBC_A_L(struct gb *gb) { SBC(&gb->r, gb->r.L); }
+void SBC_A_aHL(struct gb *gb) { SBC(&gb->r, read(gb, gb->r.HL)); }
+void SBC_A_n(struct gb *gb) { SBC(&gb->r, rpc8(gb)); }
+
+void AND_A(struct gb *gb) { AND(&gb->r, gb->r.A); }
+void AND_B(struct gb *gb) { AND(&gb->r, gb->r.B); }
+void AND_C(struct gb *gb) { AND(&gb->r, gb->r.C); }
+void AND_D(struct gb *gb) { AND(&gb->r, gb->r.D); }
+void AND_E(struct gb *gb) { AND(&gb->r, gb->r.E); }
+void AND_H(struct gb *gb) { AND(&gb->r, gb->r.H); }
+void AND_L(struct gb *gb) { AND(&gb->r, gb->r.L); }
+void AND_aHL(struct gb *gb) { AND(&gb->r, read(gb, gb->r.HL)); }
+void AND_n(struct gb *gb) { AND(&gb->r, rpc8(gb)); }
+
+void OR_A(struct gb *gb) { OR(&gb->r, gb->r.A); }
+void OR_B(struct gb *gb) { OR(&gb->r, gb->r.B); }
+void OR_C(struct gb *gb) { OR(&gb->r, gb->r.C); }
+void OR_D(struct gb *gb) { OR(&gb->r, gb->r.D); }
+void OR_E(struct gb *gb) { OR(&gb->r, gb->r.E); }
+void OR_H(struct gb *gb) { OR(&gb->r, gb->r.H); }
+void OR_L(struct gb *gb) { OR(&gb->r, gb->r.L); }
+void OR_aHL(struct gb *gb) { OR(&gb->r, read(gb, gb->r.HL)); }
+void OR_n(struct gb *gb) { OR(&gb->r, rpc8(gb)); }
+
+void XOR_A(struct gb *gb) { XOR(&gb->r, gb->r.A); }
+void XOR_B(struct gb *gb) { XOR(&gb->r, gb->r.B); }
+void XOR_C(struct gb *gb) { XOR(&gb->r, gb->r.C); }
+void XOR_D(struct gb *gb) { XOR(&gb->r, gb->r.D); }
+void XOR_E(struct gb *gb) { XOR(&gb->r, gb->r.E); }
+void XOR_H(struct gb *gb) { XOR(&gb->r, gb->r.H); }
+void XOR_L(struct gb *gb) { XOR(&gb->r, gb->r.L); }
+void XOR_aHL(struct gb *gb) { XOR(&gb->r, read(gb, gb->r.HL)); }
+void XOR_n(struct gb *gb) { XOR(&gb->r, rpc8(gb)); }
+
+void CP_A(struct gb *gb) { CP(&gb->r, gb->r.A); }
+void CP_B(struct gb *gb) { CP(&gb->r, gb->r.B); }
+void CP_C(struct gb *gb) { CP(&gb->r, gb->r.C); }
+void CP_D(struct gb *gb) { CP(&gb->r, gb->r.D); }
+void CP_E(struct gb *gb) { CP(&gb->r, gb->r.E); }
+void CP_H(struct gb *gb) { CP(&gb->r, gb->r.H); }
+void CP_L(struct gb *gb) { CP(&gb->r, gb->r.L); }
+void CP_aHL(struct gb *gb) { CP(&gb->r, read(gb, gb->r.HL)); }
+void CP_n(struct gb *gb) { CP(&gb->r, rpc8(gb)); }
+
+void INC_A(struct gb *gb) { INC(&gb->r, ++gb->r.A); }
+void INC_B(struct gb *gb) { INC(&gb->r, ++gb->r.B); }
+void INC_C(struct gb *gb) { INC(&gb->r, ++gb->r.C); }
+void INC_D(struct gb *gb) { INC(&gb->r, ++gb->r.D); }
+void INC_E(struct gb *gb) { INC(&gb->r, ++gb->r.E); }
+void INC_H(struct gb *gb) { INC(&gb->r, ++gb->r.H); }
+void INC_L(struct gb *gb) { INC(&gb->r, ++gb->r.L); }
+void INC_aHL(struct gb *gb) {
+	register uint8_t tmp = read(gb, gb->r.HL) + 1;
+	write(gb, gb->r.HL, tmp);
+	INC(&gb->r, tmp);
+}
+
+void DEC_A(struct gb *gb) { DEC(&gb->r, --gb->r.A); }
+void DEC_B(struct gb *gb) { DEC(&gb->r, --gb->r.B); }
+void DEC_C(struct gb *gb) { DEC(&gb->r, --gb->r.C); }
+void DEC_D(struct gb *gb) { DEC(&gb->r, --gb->r.D); }
+void DEC_E(struct gb *gb) { DEC(&gb->r, --gb->r.E); }
+void DEC_H(struct gb *gb) { DEC(&gb->r, --gb->r.H); }
+void DEC_L(struct gb *gb) { DEC(&gb->r, --gb->r.L); }
+void DEC_aHL(struct gb *gb) {
+	register uint8_t tmp = read(gb, gb->r.HL) - 1;
+	write(gb, gb->r.HL, tmp);
+	DEC(&gb->r, tmp);
 }
 
 
 /* **************************************** */
 /* 16-bit Arithmetic (ALU16) */
-static inline void ADD_HL(uint16_t n) {
-	r.F_N = 0;
-	r.F_H = (r.HL & 0xFFF) + (n & 0xFFF) > 0xFFF;
-	r.F_C = (r.HL + n) > 0xFFFF;
-	r.HL = r.HL + n;
-}
-void ADD_HL_BC() { ADD_HL(r.BC); }
-void ADD_HL_DE() { ADD_HL(r.DE); }
-void ADD_HL_HL() { ADD_HL(r.HL); }
-void ADD_HL_SP() { ADD_HL(r.SP); }
-
-void ADD_SP_n() {
-	register int8_t n = rpc8();
-	r.F = 0;
-	r.F_H = (r.SP & 0xF) + (n & 0xf) > 0xF;
-	r.F_C = (r.SP & 0xFF) + (n & 0xfF) > 0xFF;
-	r.SP = (uint16_t)(r.SP + n);
-}
+void ADD_HL_BC(struct gb *gb) { ADD_HL(&gb->r, gb->r.BC); }
+void ADD_HL_DE(struct gb *gb) { ADD_HL(&gb->r, gb->r.DE); }
+void ADD_HL_HL(struct gb *gb) { ADD_HL(&gb->r, gb->r.HL); }
+void ADD_HL_SP(struct gb *gb) { ADD_HL(&gb->r, gb->r.SP); }
 
-void INC_BC() { r.BC += 1; }
-void INC_DE() { r.DE += 1; }
-void INC_HL() { r.HL += 1; }
-void INC_SP() { r.SP += 1; }
+void ADD_SP_n(struct gb *gb) { gb->r.SP = SP_n(&gb->r, rpc8(gb)); }
 
-void DEC_BC() { r.BC -= 1; }
-void DEC_DE() { r.DE -= 1; }
-void DEC_HL() { r.HL -= 1; }
-void DEC_SP() { r.SP -= 1; }
+void INC_BC(struct gb *gb) { gb->r.BC += 1; }
+void INC_DE(struct gb *gb) { gb->r.DE += 1; }
+void INC_HL(struct gb *gb) { gb->r.HL += 1; }
+void INC_SP(struct gb *gb) { gb->r.SP += 1; }
+
+void DEC_BC(struct gb *gb) { gb->r.BC -= 1; }
+void DEC_DE(struct gb *gb) { gb->r.DE -= 1; }
+void DEC_HL(struct gb *gb) { gb->r.HL -= 1; }
+void DEC_SP(struct gb *gb) { gb->r.SP -= 1; }
 
 /* **************************************** */
 /* Rotates & Shifts */
-void RLCA() {
-	register uint8_t bit = (r.A >> 7) & 1;
-	r.A = (r.A << 1) | bit;
-	r.F = 0;
-	r.F_C = bit;
-	r.F_Z = !r.A;
-}
-void RLA() {
-	register uint8_t bit = (r.A >> 7) & 1;
-	r.A = (r.A << 1) | r.F_C;
-	r.F = 0;
-	r.F_C = bit;
-	r.F_Z = !r.A;
-}
-void RRCA() {
-	register uint8_t bit = r.A & 1;
-	r.A = (r.A >> 1) | (bit << 7);
-	r.F = 0;
-	r.F_C = bit;
-	r.F_Z = !r.A;
-}
-void RRA() {
-	register uint8_t bit = r.A & 1;
-	r.A = (r.A >> 1) | (r.F_C << 7);
-	r.F = 0;
-	r.F_C = bit;
-	r.F_Z = !r.A;
-}
+void RLCA(struct gb *gb) { ROT_A(&gb->r, ALU_RLC); }
+void RLA(struct gb *gb) { ROT_A(&gb->r, ALU_RL); }
+void RRCA(struct gb *gb) { ROT_A(&gb->r, ALU_RRC); }
+void RRA(struct gb *gb) { ROT_A(&gb->r, ALU_RR); }
 
 
 /* **************************************** */
 /* Jumps */
-void JP() { r.PC = rpc16(); }
-void JP_NZ() {
-	register uint16_t addr = rpc16();
-	if(!r.F_Z) {
-		r.PC = addr;
+void JP(struct gb *gb) { gb->r.PC = rpc16(gb); }
+void JP_NZ(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(!gb->r.F_Z) {
+		gb->r.PC = addr;
 	}
 }
-void JP_Z() {
-	register uint16_t addr = rpc16();
-	if(r.F_Z) {
-		r.PC = addr;
+void JP_Z(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(gb->r.F_Z) {
+		gb->r.PC = addr;
 	}
 }
-void JP_NC() {
-	register uint16_t addr = rpc16();
-	if(!r.F_C) {
-		r.PC = addr;
+void JP_NC(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(!gb->r.F_C) {
+		gb->r.PC = addr;
 	}
 }
-void JP_C() {
-	register uint16_t addr = rpc16();
-	if(r.F_C) {
-		r.PC = addr;
+void JP_C(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(gb->r.F_C) {
+		gb->r.PC = addr;
 	}
 }
-void JP_HL() { r.PC = r.HL; }
+void JP_HL(struct gb *gb) { gb->r.PC = gb->r.HL; }
 
-static inline void JR(int8_t n) {
-	r.PC += n;
+static inline void JR(struct gb *gb, int8_t n) {
+	gb->r.PC += n;
 }
 
-void JR_n() { JR(rpc8()); }
+void JR_n(struct gb *gb) { JR(gb, rpc8(gb)); }
 
-void JR_NZ_n() {
-	register uint8_t n = rpc8();
-	if(!r.F_Z) {
-		JR(n);
+void JR_NZ_n(struct gb *gb) {
+	register uint8_t n = rpc8(gb);
+	if(!gb->r.F_Z) {
+		JR(gb, n);
 	}
 }
-void JR_Z_n() {
-	register uint8_t n = rpc8();
-	if(r.F_Z) {
-		JR(n);
+void JR_Z_n(struct gb *gb) {
+	register uint8_t n = rpc8(gb);
+	if(gb->r.F_Z) {
+		JR(gb, n);
 	}
 }
-void JR_NC_n() {
-	register uint8_t n = rpc8();
-	if(!r.F_C) {
-		JR(n);
+void JR_NC_n(struct gb *gb) {
+	register uint8_t n = rpc8(gb);
+	if(!gb->r.F_C) {
+		JR(gb, n);
 	}
 }
-void JR_C_n() {
-	register uint8_t n = rpc8();
-	if(r.F_C) {
-		JR(n);
+void JR_C_n(struct gb *gb) {
+	register uint8_t n = rpc8(gb);
+	if(gb->r.F_C) {
+		JR(gb, n);
 	}
 }
 
 /* **************************************** */
 /* Calls */
-static inline void CALL(uint16_t address) {
-	PUSH16(r.PC);
-	r.PC = address;
+static inline void CALL(struct gb *gb, uint16_t address) {
+	PUSH16(gb, gb->r.PC);
+	gb->r.PC = address;
 }
 
-void CALL_nn() { CALL(rpc16()); }
+void CALL_nn(struct gb *gb) { CALL(gb, rpc16(gb)); }
 
-void CALL_NZ_nn() {
-	register uint16_t addr = rpc16();
-	if(!r.F_Z) {
-		CALL(addr);
+void CALL_NZ_nn(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(!gb->r.F_Z) {
+		CALL(gb, addr);
 	}
 }
-void CALL_Z_nn() {
-	register uint16_t addr = rpc16();
-	if(r.F_Z) {
-		CALL(addr);
+void CALL_Z_nn(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(gb->r.F_Z) {
+		CALL(gb, addr);
 	}
 }
-void CALL_NC_nn() {
-	register uint16_t addr = rpc16();
-	if(!r.F_C) {
-		CALL(addr);
+void CALL_NC_nn(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(!gb->r.F_C) {
+		CALL(gb, addr);
 	}
 }
-void CALL_C_nn() {
-	register uint16_t addr = rpc16();
-	if(r.F_C) {
-		CALL(addr);
+void CALL_C_nn(struct gb *gb) {
+	register uint16_t addr = rpc16(gb);
+	if(gb->r.F_C) {
+		CALL(gb, addr);
 	}
 }
 
 /* **************************************** */
 /* Restarts */
-void RST00() { r.PC = 0x00; }
-void RST08() { r.PC = 0x08; }
-void RST10() { r.PC = 0x10; }
-void RST18() { r.PC = 0x18; }
-void RST20() { r.PC = 0x20; }
-void RST28() { r.PC = 0x28; }
-void RST30() { r.PC = 0x30; }
-void RST38() { r.PC = 0x38; }
+void RST00(struct gb *gb) { CALL(gb, 0x00); }
+void RST08(struct gb *gb) { CALL(gb, 0x08); }
+void RST10(struct gb *gb) { CALL(gb, 0x10); }
+void RST18(struct gb *gb) { CALL(gb, 0x18); }
+void RST20(struct gb *gb) { CALL(gb, 0x20); }
+void RST28(struct gb *gb) { CALL(gb, 0x28); }
+void RST30(struct gb *gb) { CALL(gb, 0x30); }
+void RST38(struct gb *gb) { CALL(gb, 0x38); }
 
 /* **************************************** */
 /* Misc */
-void CPL() {
-	r.F_N = 1;
-	r.F_H = 1;
-	r.A ^= 0xFF;
-}
-void CCF() {
-	r.F_N = r.F_H = 0;
-	r.F_C ^= 1;
+void CPL(struct gb *gb) {
+	gb->r.F_N = 1;
+	gb->r.F_H = 1;
+	gb->r.A ^= 0xFF;
 }
-void SCF() {
-	r.F_N = r.F_H = 0;
-	r.F_C = 1;
+void CCF(struct gb *gb) {
+	gb->r.F_N = gb->r.F_H = 0;
+	gb->r.F_C ^= 1;
 }
-void DAA() {
-	/* //sigh// let's get this shit over with */
-	register int32_t tmp = r.A;
-	
-	if(r.F_N) {
-		if(r.F_H) {
-			tmp -= 6;
-			if(!r.F_C) {
-				tmp &= 0xFF;
-			}
-		}
-		if(r.F_C) {
-			tmp -= 0x60;
-		}
-	} else {
-		if(r.F_H || (tmp & 0xF) > 0x9) {
-			tmp += 0x6;
-		}
-		if(r.F_C || tmp > 0x9F) {
-			tmp += 0x60;
-		}
-	}
-	
-	r.F_H = 0;
-	if(tmp & 0x100)
-		r.F_C = 1;
-	r.A = tmp & 0xFF;
-	r.F_Z = !r.A;
+void SCF(struct gb *gb) {
+	gb->r.F_N = gb->r.F_H = 0;
+	gb->r.F_C = 1;
 }
-void HALT() { /* DO HALT */ }
-void STOP() { }
+void DAA(struct gb *gb) { DAA_r(&gb->r); }
+void HALT(struct gb *gb) { cpu_halt(gb); }
+void STOP(struct gb *gb) { }
 
-void DI() { }
-void EI() { }
+void DI(struct gb *gb) { cpu_ime(gb, 0); }
+void EI(struct gb *gb) { cpu_ei(gb); }
 
 /* **************************************** */
 /* Return */
-void RET() { r.PC = POP16(); }
+void RET(struct gb *gb) { gb->r.PC = POP16(gb); }
 
-void RET_NZ() {
-	if(!r.F_Z) {
-		RET();
+void RET_NZ(struct gb *gb) {
+	if(!gb->r.F_Z) {
+		RET(gb);
 	}
 }
-void RET_Z() {
-	if(r.F_Z) {
-		RET();
+void RET_Z(struct gb *gb) {
+	if(gb->r.F_Z) {
+		RET(gb);
 	}
 }
-void RET_NC() {
-	if(!r.F_C) {
-		RET();
+void RET_NC(struct gb *gb) {
+	if(!gb->r.F_C) {
+		RET(gb);
 	}
 }
-void RET_C() {
-	if(r.F_C) {
-		RET();
+void RET_C(struct gb *gb) {
+	if(gb->r.F_C) {
+		RET(gb);
 	}
 }
 
-void RETI() { RET(); EI(); }
+void RETI(struct gb *gb) { RET(gb); cpu_ime(gb, 1); }
+
+/* **************************************** */
+/* Fused groups, see cpu_instr_fuse.h */
+/* moves on to the operand bytes and opcode of the next op in the group, and
+ * the clock past the op before, so every op reads and stores on its own cycle */
+#define FUSE_NEXT(op) (gb->cycle_counter += instr_timing[op] << 2, \
+	gb->imm >>= 8 * (instr_length[op] - 1), ++gb->r.PC)
+#define FUSE2_DEFINE(a, na, b, nb) \
+	void na##_##nb(struct gb *gb) { na(gb); FUSE_NEXT(a); nb(gb); }
+#define FUSE3_DEFINE(a, na, b, nb, c, nc) \
+	void na##_##nb##_##nc(struct gb *gb) { na(gb); FUSE_NEXT(a); nb(gb); FUSE_NEXT(b); nc(gb); }
+FUSED_OPCODES(FUSE2_DEFINE, FUSE3_DEFINE)
@@ -18,267 +18,291 @@
 
 /* Defines the general CPU instructions. */
 
+typedef void (*instruction_f)(struct gb *);
+
+/* cpu.c */
+extern const instruction_f instr_map[256];
+extern const instruction_f instr_cb_map[256];
+extern const char *const instr_names[256];
+extern const char *const instr_cb_names[256];
+
+/* in machine cycles */
+extern const uint8_t instr_timing[256];
+extern const uint8_t instr_cb_timing[256];
+extern const uint8_t instr_length[256];
+
+void step_cb(struct gb *);
+
+/* Runs instructions until cycle_counter reaches the given cycle, always at
+ * least one, firing the scheduled events on the way. */
+void cpu_exec(struct gb *, uint64_t);
+/* Runs instructions until cycle_counter reaches gb->until, always at least
+ * one. Provided by whichever interpreter core is built in. */
+void cpu_run(struct gb *);
+
 /* 8-bit Loads */
-void LD_A_n();
-void LD_B_n();
-void LD_C_n();
-void LD_D_n();
-void LD_E_n();
-void LD_H_n();
-void LD_L_n();
-void LD_aHL_n();
-void LD_A_A();
-void LD_A_B();
-void LD_A_C();
-void LD_A_D();
-void LD_A_E();
-void LD_A_H();
-void LD_A_L();
-void LD_A_aHL();
-void LD_A_aC();
-void LD_aC_A();
-void LD_A_aBC();
-void LD_A_aDE();
-void LD_A_ann();
-void LD_B_A();
-void LD_B_B();
-void LD_B_C();
-void LD_B_D();
-void LD_B_E();
-void LD_B_H();
-void LD_B_L();
-void LD_B_aHL();
-void LD_C_A();
-void LD_C_B();
-void LD_C_C();
-void LD_C_D();
-void LD_C_E();
-void LD_C_H();
-void LD_C_L();
-void LD_C_aHL();
-void LD_D_A();
-void LD_D_B();
-void LD_D_C();
-void LD_D_D();
-void LD_D_E();
-void LD_D_H();
-void LD_D_L();
-void LD_D_aHL();
-void LD_E_A();
-void LD_E_B();
-void LD_E_C();
-void LD_E_D();
-void LD_E_E();
-void LD_E_H();
-void LD_E_L();
-void LD_E_aHL();
-void LD_H_A();
-void LD_H_B();
-void LD_H_C();
-void LD_H_D();
-void LD_H_E();
-void LD_H_H();
-void LD_H_L();
-void LD_H_aHL();
-void LD_L_A();
-void LD_L_B();
-void LD_L_C();
-void LD_L_D();
-void LD_L_E();
-void LD_L_H();
-void LD_L_L();
-void LD_L_aHL();
-void LD_aHL_A();
-void LD_aHL_B();
-void LD_aHL_C();
-void LD_aHL_D();
-void LD_aHL_E();
-void LD_aHL_H();
-void LD_aHL_L();
-void LD_aBC_A();
-void LD_aDE_A();
-void LD_ann_A();
-void LDD_A_aHL();
-void LDD_aHL_A();
-void LDI_A_aHL();
-void LDI_aHL_A();
-void LDH_A_an();
-void LDH_an_A();
+void LD_A_n(struct gb *);
+void LD_B_n(struct gb *);
+void LD_C_n(struct gb *);
+void LD_D_n(struct gb *);
+void LD_E_n(struct gb *);
+void LD_H_n(struct gb *);
+void LD_L_n(struct gb *);
+void LD_aHL_n(struct gb *);
+void LD_A_A(struct gb *);
+void LD_A_B(struct gb *);
+void LD_A_C(struct gb *);
+void LD_A_D(struct gb *);
+void LD_A_E(struct gb *);
+void LD_A_H(struct gb *);
+void LD_A_L(struct gb *);
+void LD_A_aHL(struct gb *);
+void LD_A_aC(struct gb *);
+void LD_aC_A(struct gb *);
+void LD_A_aBC(struct gb *);
+void LD_A_aDE(struct gb *);
+void LD_A_ann(struct gb *);
+void LD_B_A(struct gb *);
+void LD_B_B(struct gb *);
+void LD_B_C(struct gb *);
+void LD_B_D(struct gb *);
+void LD_B_E(struct gb *);
+void LD_B_H(struct gb *);
+void LD_B_L(struct gb *);
+void LD_B_aHL(struct gb *);
+void LD_C_A(struct gb *);
+void LD_C_B(struct gb *);
+void LD_C_C(struct gb *);
+void LD_C_D(struct gb *);
+void LD_C_E(struct gb *);
+void LD_C_H(struct gb *);
+void LD_C_L(struct gb *);
+void LD_C_aHL(struct gb *);
+void LD_D_A(struct gb *);
+void LD_D_B(struct gb *);
+void LD_D_C(struct gb *);
+void LD_D_D(struct gb *);
+void LD_D_E(struct gb *);
+void LD_D_H(struct gb *);
+void LD_D_L(struct gb *);
+void LD_D_aHL(struct gb *);
+void LD_E_A(struct gb *);
+void LD_E_B(struct gb *);
+void LD_E_C(struct gb *);
+void LD_E_D(struct gb *);
+void LD_E_E(struct gb *);
+void LD_E_H(struct gb *);
+void LD_E_L(struct gb *);
+void LD_E_aHL(struct gb *);
+void LD_H_A(struct gb *);
+void LD_H_B(struct gb *);
+void LD_H_C(struct gb *);
+void LD_H_D(struct gb *);
+void LD_H_E(struct gb *);
+void LD_H_H(struct gb *);
+void LD_H_L(struct gb *);
+void LD_H_aHL(struct gb *);
+void LD_L_A(struct gb *);
+void LD_L_B(struct gb *);
+void LD_L_C(struct gb *);
+void LD_L_D(struct gb *);
+void LD_L_E(struct gb *);
+void LD_L_H(struct gb *);
+void LD_L_L(struct gb *);
+void LD_L_aHL(struct gb *);
+void LD_aHL_A(struct gb *);
+void LD_aHL_B(struct gb *);
+void LD_aHL_C(struct gb *);
+void LD_aHL_D(struct gb *);
+void LD_aHL_E(struct gb *);
+void LD_aHL_H(struct gb *);
+void LD_aHL_L(struct gb *);
+void LD_aBC_A(struct gb *);
+void LD_aDE_A(struct gb *);
+void LD_ann_A(struct gb *);
+void LDD_A_aHL(struct gb *);
+void LDD_aHL_A(struct gb *);
+void LDI_A_aHL(struct gb *);
+void LDI_aHL_A(struct gb *);
+void LDH_A_an(struct gb *);
+void LDH_an_A(struct gb *);
 
 /* 16-bit loads */
-void LD_BC_nn();
-void LD_DE_nn();
-void LD_HL_nn();
-void LD_SP_nn();
-void LD_SP_HL();
-void LDHL_SP_n();
-void LD_ann_SP();
-void PUSH_AF();
-void PUSH_BC();
-void PUSH_DE();
-void PUSH_HL();
-void POP_AF();
-void POP_BC();
-void POP_DE();
-void POP_HL();
+void LD_BC_nn(struct gb *);
+void LD_DE_nn(struct gb *);
+void LD_HL_nn(struct gb *);
+void LD_SP_nn(struct gb *);
+void LD_SP_HL(struct gb *);
+void LDHL_SP_n(struct gb *);
+void LD_ann_SP(struct gb *);
+void PUSH_AF(struct gb *);
+void PUSH_BC(struct gb *);
+void PUSH_DE(struct gb *);
+void PUSH_HL(struct gb *);
+void POP_AF(struct gb *);
+void POP_BC(struct gb *);
+void POP_DE(struct gb *);
+void POP_HL(struct gb *);
 
 /* 8-bit Arithmetic (ALU8) */
-void ADD_A_A();
-void ADD_A_B();
-void ADD_A_C();
-void ADD_A_D();
-void ADD_A_E();
-void ADD_A_H();
-void ADD_A_L();
-void ADD_A_aHL();
-void ADD_A_n();
-void ADC_A_A();
-void ADC_A_B();
-void ADC_A_C();
-void ADC_A_D();
-void ADC_A_E();
-void ADC_A_H();
-void ADC_A_L();
-void ADC_A_aHL();
-void ADC_A_n();
-void SUB_A();
-void SUB_B();
-void SUB_C();
-void SUB_D();
-void SUB_E();
-void SUB_H();
-void SUB_L();
-void SUB_aHL();
-void SUB_n();
-void SBC_A_A();
-void SBC_A_B();
-void SBC_A_C();
-void SBC_A_D();
-void SBC_A_E();
-void SBC_A_H();
-void SBC_A_L();
-void SBC_A_aHL();
-void SBC_A_n();
-void AND_A();
-void AND_B();
-void AND_C();
-void AND_D();
-void AND_E();
-void AND_H();
-void AND_L();
-void AND_aHL();
-void AND_n();
-void OR_A();
-void OR_B();
-void OR_C();
-void OR_D();
-void OR_E();
-void OR_H();
-void OR_L();
-void OR_aHL();
-void OR_n();
-void XOR_A();
-void XOR_B();
-void XOR_C();
-void XOR_D();
-void XOR_E();
-void XOR_H();
-void XOR_L();
-void XOR_aHL();
-void XOR_n();
-void CP_A();
-void CP_B();
-void CP_C();
-void CP_D();
-void CP_E();
-void CP_H();
-void CP_L();
-void CP_aHL();
-void CP_n();
-void INC_A();
-void INC_B();
-void INC_C();
-void INC_D();
-void INC_E();
-void INC_H();
-void INC_L();
-void INC_aHL();
-void DEC_A();
-void DEC_B();
-void DEC_C();
-void DEC_D();
-void DEC_E();
-void DEC_H();
-void DEC_L();
-void DEC_aHL();
+void ADD_A_A(struct gb *);
+void ADD_A_B(struct gb *);
+void ADD_A_C(struct gb *);
+void ADD_A_D(struct gb *);
+void ADD_A_E(struct gb *);
+void ADD_A_H(struct gb *);
+void ADD_A_L(struct gb *);
+void ADD_A_aHL(struct gb *);
+void ADD_A_n(struct gb *);
+void ADC_A_A(struct gb *);
+void ADC_A_B(struct gb *);
+void ADC_A_C(struct gb *);
+void ADC_A_D(struct gb *);
+void ADC_A_E(struct gb *);
+void ADC_A_H(struct gb *);
+void ADC_A_L(struct gb *);
+void ADC_A_aHL(struct gb *);
+void ADC_A_n(struct gb *);
+void SUB_A(struct gb *);
+void SUB_B(struct gb *);
+void SUB_C(struct gb *);
+void SUB_D(struct gb *);
+void SUB_E(struct gb *);
+void SUB_H(struct gb *);
+void SUB_L(struct gb *);
+void SUB_aHL(struct gb *);
+void SUB_n(struct gb *);
+void SBC_A_A(struct gb *);
+void SBC_A_B(struct gb *);
+void SBC_A_C(struct gb *);
+void SBC_A_D(struct gb *);
+void SBC_A_E(struct gb *);
+void SBC_A_H(struct gb *);
+void SBC_A_L(struct gb *);
+void SBC_A_aHL(struct gb *);
+void SBC_A_n(struct gb *);
+void AND_A(struct gb *);
+void AND_B(struct gb *);
+void AND_C(struct gb *);
+void AND_D(struct gb *);
+void AND_E(struct gb *);
+void AND_H(struct gb *);
+void AND_L(struct gb *);
+void AND_aHL(struct gb *);
+void AND_n(struct gb *);
+void OR_A(struct gb *);
+void OR_B(struct gb *);
+void OR_C(struct gb *);
+void OR_D(struct gb *);
+void OR_E(struct gb *);
+void OR_H(struct gb *);
+void OR_L(struct gb *);
+void OR_aHL(struct gb *);
+void OR_n(struct gb *);
+void XOR_A(struct gb *);
+void XOR_B(struct gb *);
+void XOR_C(struct gb *);
+void XOR_D(struct gb *);
+void XOR_E(struct gb *);
+void XOR_H(struct gb *);
+void XOR_L(struct gb *);
+void XOR_aHL(struct gb *);
+void XOR_n(struct gb *);
+void CP_A(struct gb *);
+void CP_B(struct gb *);
+void CP_C(struct gb *);
+void CP_D(struct gb *);
+void CP_E(struct gb *);
+void CP_H(struct gb *);
+void CP_L(struct gb *);
+void CP_aHL(struct gb *);
+void CP_n(struct gb *);
+void INC_A(struct gb *);
+void INC_B(struct gb *);
+void INC_C(struct gb *);
+void INC_D(struct gb *);
+void INC_E(struct gb *);
+void INC_H(struct gb *);
+void INC_L(struct gb *);
+void INC_aHL(struct gb *);
+void DEC_A(struct gb *);
+void DEC_B(struct gb *);
+void DEC_C(struct gb *);
+void DEC_D(struct gb *);
+void DEC_E(struct gb *);
+void DEC_H(struct gb *);
+void DEC_L(struct gb *);
+void DEC_aHL(struct gb *);
 
 /* 16-bit Arithmetic (ALU16) */
-void ADD_HL_BC();
-void ADD_HL_DE();
-void ADD_HL_HL();
-void ADD_HL_SP();
-void ADD_SP_n();
-void INC_BC();
-void INC_DE();
-void INC_HL();
-void INC_SP();
-void DEC_BC();
-void DEC_DE();
-void DEC_HL();
-void DEC_SP();
+void ADD_HL_BC(struct gb *);
+void ADD_HL_DE(struct gb *);
+void ADD_HL_HL(struct gb *);
+void ADD_HL_SP(struct gb *);
+void ADD_SP_n(struct gb *);
+void INC_BC(struct gb *);
+void INC_DE(struct gb *);
+void INC_HL(struct gb *);
+void INC_SP(struct gb *);
+void DEC_BC(struct gb *);
+void DEC_DE(struct gb *);
+void DEC_HL(struct gb *);
+void DEC_SP(struct gb *);
 
 /* Rotates & Shifts */
-void RLCA();
-void RLA();
-void RRCA();
-void RRA();
+void RLCA(struct gb *);
+void RLA(struct gb *);
+void RRCA(struct gb *);
+void RRA(struct gb *);
 
 /* Jumps */
-void JP();
-void JP_NZ();
-void JP_Z();
-void JP_NC();
-void JP_C();
-void JP_HL();
-void JR_n();
-void JR_NZ_n();
-void JR_Z_n();
-void JR_NC_n();
-void JR_C_n();
+void JP(struct gb *);
+void JP_NZ(struct gb *);
+void JP_Z(struct gb *);
+void JP_NC(struct gb *);
+void JP_C(struct gb *);
+void JP_HL(struct gb *);
+void JR_n(struct gb *);
+void JR_NZ_n(struct gb *);
+void JR_Z_n(struct gb *);
+void JR_NC_n(struct gb *);
+void JR_C_n(struct gb *);
 
 /* Calls */
-void CALL_nn();
-void CALL_NZ_nn();
-void CALL_Z_nn();
-void CALL_NC_nn();
-void CALL_C_nn();
+void CALL_nn(struct gb *);
+void CALL_NZ_nn(struct gb *);
+void CALL_Z_nn(struct gb *);
+void CALL_NC_nn(struct gb *);
+void CALL_C_nn(struct gb *);
 
 /* Restarts */
-void RST00();
-void RST08();
-void RST10();
-void RST18();
-void RST20();
-void RST28();
-void RST30();
-void RST38();
+void RST00(struct gb *);
+void RST08(struct gb *);
+void RST10(struct gb *);
+void RST18(struct gb *);
+void RST20(struct gb *);
+void RST28(struct gb *);
+void RST30(struct gb *);
+void RST38(struct gb *);
 
 /* Misc */
-void CPL();
-void CCF();
-void SCF();
-void DAA();
-void HALT();
-void STOP();
-void DI();
-void EI();
+void NOP(struct gb *);
+void XXX(struct gb *); /* missing opcode */
+void CPL(struct gb *);
+void CCF(struct gb *);
+void SCF(struct gb *);
+void DAA(struct gb *);
+void HALT(struct gb *);
+void STOP(struct gb *);
+void DI(struct gb *);
+void EI(struct gb *);
 
 /* Return */
-void RET();
-void RET_NZ();
-void RET_Z();
-void RET_NC();
-void RET_C();
-void RETI();
+void RET(struct gb *);
+void RET_NZ(struct gb *);
+void RET_Z(struct gb *);
+void RET_NC(struct gb *);
+void RET_C(struct gb *);
+void RETI(struct gb *);
 
 #endif /* _CPU_INSTR_H_ */
@@ -16,100 +16,36 @@
 #ifndef _CPU_INSTR_CB_H_
 #define _CPU_INSTR_CB_H_
 
-/* This file defines the DMG two byte 0xCB instructions. */
-void SWAP_A();
-void SWAP_B();
-void SWAP_C();
-void SWAP_D();
-void SWAP_E();
-void SWAP_H();
-void SWAP_L();
-void SWAP_aHL();
-
-void RLC_B();
-void RLC_C();
-void RLC_D();
-void RLC_E();
-void RLC_H();
-void RLC_L();
-void RLC_aHL();
-
-void RL_B();
-void RL_C();
-void RL_D();
-void RL_E();
-void RL_H();
-void RL_L();
-void RL_aHL();
-
-void RRC_B();
-void RRC_C();
-void RRC_D();
-void RRC_E();
-void RRC_H();
-void RRC_L();
-void RRC_aHL();
-
-void RR_B();
-void RR_C();
-void RR_D();
-void RR_E();
-void RR_H();
-void RR_L();
-void RR_aHL();
-
-void SLA_A();
-void SLA_B();
-void SLA_C();
-void SLA_D();
-void SLA_E();
-void SLA_H();
-void SLA_L();
-void SLA_aHL();
-
-void SRA_A();
-void SRA_B();
-void SRA_C();
-void SRA_D();
-void SRA_E();
-void SRA_H();
-void SRA_L();
-void SRA_aHL();
-
-void SRL_A();
-void SRL_B();
-void SRL_C();
-void SRL_D();
-void SRL_E();
-void SRL_H();
-void SRL_L();
-void SRL_aHL();
-
-void BIT_b_A(uint8_t);
-void BIT_b_B(uint8_t);
-void BIT_b_C(uint8_t);
-void BIT_b_D(uint8_t);
-void BIT_b_E(uint8_t);
-void BIT_b_H(uint8_t);
-void BIT_b_L(uint8_t);
-void BIT_b_aHL(uint8_t);
-
-void RES_b_A(uint8_t b);
-void RES_b_B(uint8_t b);
-void RES_b_C(uint8_t b);
-void RES_b_D(uint8_t b);
-void RES_b_E(uint8_t b);
-void RES_b_H(uint8_t b);
-void RES_b_L(uint8_t b);
-void RES_b_aHL(uint8_t b);
-
-void SET_b_A(uint8_t b);
-void SET_b_B(uint8_t b);
-void SET_b_C(uint8_t b);
-void SET_b_D(uint8_t b);
-void SET_b_E(uint8_t b);
-void SET_b_H(uint8_t b);
-void SET_b_L(uint8_t b);
-void SET_b_aHL(uint8_t b);
+/* This file defines the DMG two byte 0xCB instructions.
+ *
+ * Every CB opcode gets its own handler so the bit number of BIT, RES and SET
+ * is a constant in the handler instead of an argument. CB_OPCODES expands
+ * X(op, name, bit, reg) once per opcode in opcode order, so the handlers, the
+ * dispatch table and the names are all generated from the one list. The
+ * rotates and shifts pass 0 for bit. */
+#define CB_ROW(X, op, name, b) \
+	X(op, name##_B, b, B) X(op, name##_C, b, C) X(op, name##_D, b, D) X(op, name##_E, b, E) \
+	X(op, name##_H, b, H) X(op, name##_L, b, L) X(op, name##_aHL, b, aHL) X(op, name##_A, b, A)
+
+#define CB_BITS(X, op) \
+	CB_ROW(X, op, op##_0, 0) CB_ROW(X, op, op##_1, 1) CB_ROW(X, op, op##_2, 2) CB_ROW(X, op, op##_3, 3) \
+	CB_ROW(X, op, op##_4, 4) CB_ROW(X, op, op##_5, 5) CB_ROW(X, op, op##_6, 6) CB_ROW(X, op, op##_7, 7)
+
+#define CB_OPCODES(X) \
+	CB_ROW(X, RLC, RLC, 0)	/* 00-07 */ \
+	CB_ROW(X, RRC, RRC, 0)	/* 08-0f */ \
+	CB_ROW(X, RL, RL, 0)	/* 10-17 */ \
+	CB_ROW(X, RR, RR, 0)	/* 18-1f */ \
+	CB_ROW(X, SLA, SLA, 0)	/* 20-27 */ \
+	CB_ROW(X, SRA, SRA, 0)	/* 28-2f */ \
+	CB_ROW(X, SWAP, SWAP, 0)	/* 30-37 */ \
+	CB_ROW(X, SRL, SRL, 0)	/* 38-3f */ \
+	CB_BITS(X, BIT)	/* 40-7f */ \
+	CB_BITS(X, RES)	/* 80-bf */ \
+	CB_BITS(X, SET)	/* c0-ff */
+
+#define CB_DECLARE(op, name, b, r) void name(struct gb *);
+CB_OPCODES(CB_DECLARE)
+#undef CB_DECLARE
 
 #endif
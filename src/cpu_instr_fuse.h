@@ -0,0 +1,67 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CPU_INSTR_FUSE_H_
+#define _CPU_INSTR_FUSE_H_
+
+/* This file defines the fused handlers, one handler for a run of two or three
+ * opcodes that show up back to back a lot.
+ *
+ * FUSED_OPCODES expands X3(op, name, op, name, op, name) for every triple and
+ * X2(op, name, op, name) for every pair. block.c swaps a group in whenever the
+ * predecoded ops match one, trying the entries in order, so the triples come
+ * first. The operand bytes of the group are packed into gb->imm in order and
+ * each handler shifts its bytes out for the next one.
+ *
+ * The list comes from failboy --pairs, which prints the most common groups in
+ * this form. Only the last op of a group may jump, store or be a CB op, see
+ * block_can_fuse(). */
+#define FUSED_OPCODES(X2, X3) \
+	X3(0xF0, LDH_A_an, 0xE6, AND_n, 0x20, JR_NZ_n)	/* polling a register */ \
+	X3(0xF0, LDH_A_an, 0xE6, AND_n, 0x28, JR_Z_n) \
+	X3(0xF0, LDH_A_an, 0xFE, CP_n, 0x20, JR_NZ_n) \
+	X3(0xF0, LDH_A_an, 0xFE, CP_n, 0x28, JR_Z_n) \
+	X3(0x2A, LDI_A_aHL, 0xB7, OR_A, 0x28, JR_Z_n)	/* zero terminated strings */ \
+	X3(0x78, LD_A_B, 0xB1, OR_C, 0x20, JR_NZ_n)	/* DEC BC loop counters */ \
+	X2(0x2A, LDI_A_aHL, 0x12, LD_aDE_A)	/* copy loops */ \
+	X2(0x2A, LDI_A_aHL, 0x22, LDI_aHL_A) \
+	X2(0x05, DEC_B, 0x20, JR_NZ_n)	/* counted loops */ \
+	X2(0x0D, DEC_C, 0x20, JR_NZ_n) \
+	X2(0x15, DEC_D, 0x20, JR_NZ_n) \
+	X2(0x1D, DEC_E, 0x20, JR_NZ_n) \
+	X2(0x3D, DEC_A, 0x20, JR_NZ_n) \
+	X2(0xFE, CP_n, 0x20, JR_NZ_n) \
+	X2(0xFE, CP_n, 0x28, JR_Z_n) \
+	X2(0xB7, OR_A, 0x28, JR_Z_n) \
+	X2(0x3E, LD_A_n, 0xE0, LDH_an_A)	/* register setup */ \
+	X2(0xF0, LDH_A_an, 0xFE, CP_n)
+
+struct fused_op {
+	uint8_t n; /* 2 or 3 */
+	uint8_t ops[3];
+	void (*fn)(struct gb *);
+};
+
+/* cpu.c */
+extern const struct fused_op instr_fused[];
+extern const unsigned instr_nfused;
+
+#define FUSE2_DECLARE(a, na, b, nb) void na##_##nb(struct gb *);
+#define FUSE3_DECLARE(a, na, b, nb, c, nc) void na##_##nb##_##nc(struct gb *);
+FUSED_OPCODES(FUSE2_DECLARE, FUSE3_DECLARE)
+#undef FUSE2_DECLARE
+#undef FUSE3_DECLARE
+
+#endif /* _CPU_INSTR_FUSE_H_ */
@@ -0,0 +1,398 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Switch based interpreter core, built with -DCORE_SWITCH (make CORE=switch).
+ *
+ * Instead of calling through instr_map for every opcode the whole decode lives
+ * in cpu_run(). The registers are copied into a local for the duration of the
+ * run so the compiler can keep them in host registers, and only written back
+ * to gb->r once we return. The cycle counter stays in gb, the IO registers
+ * need the current time. The semantics have to match cpu_instr.c exactly,
+ * which is why both use the helpers in cpu_alu.h.
+ */
+
+#ifdef CORE_SWITCH
+
+#include "failboy.h"
+#include "cpu_instr.h"
+#include "cpu_alu.h"
+
+const char *cpu_core = "switch";
+
+#define FETCH8() (read(gb, reg.PC++))
+#define FETCH16() (reg.PC += 2, read16(gb, reg.PC - 2))
+
+#define PUSH(n) do { reg.SP -= 2; write16(gb, reg.SP, (n)); } while(0)
+#define POP(x) do { (x) = read16(gb, reg.SP); reg.SP += 2; } while(0)
+
+/* Expands to the eight cases of an opcode row, B C D E H L (HL) A. */
+#define ROW(base, OP) \
+	case (base) + 0: OP(reg.B); break; \
+	case (base) + 1: OP(reg.C); break; \
+	case (base) + 2: OP(reg.D); break; \
+	case (base) + 3: OP(reg.E); break; \
+	case (base) + 4: OP(reg.H); break; \
+	case (base) + 5: OP(reg.L); break; \
+	case (base) + 6: OP(read(gb, reg.HL)); break; \
+	case (base) + 7: OP(reg.A); break;
+
+#define LD_C(n) reg.C = (n)
+#define LD_D(n) reg.D = (n)
+#define LD_E(n) reg.E = (n)
+#define LD_H(n) reg.H = (n)
+#define LD_L(n) reg.L = (n)
+#define LD_A(n) reg.A = (n)
+
+#ifdef LAZY_FLAGS
+/*
+ * Lazy flags, built with -DLAZY_FLAGS (make LAZY=1). The 8-bit ALU ops only
+ * record what they did, and F is worked out from that when something reads
+ * it. FLAGS() brings reg.F up to date and has to come before anything that
+ * reads or partly updates F. Z comes straight off the recorded result, which
+ * keeps the usual DEC/JR NZ loops from ever building F.
+ */
+enum { LF_NONE, LF_ADD, LF_SUB, LF_AND, LF_OR, LF_INC, LF_DEC };
+
+struct lazy {
+	uint8_t op;
+	uint8_t a, n, c; /* operands and carry in of LF_ADD and LF_SUB */
+	uint8_t res;
+};
+
+static inline void lazy_flags(struct registers *reg, struct lazy *lf) {
+	switch(lf->op) {
+		case LF_ADD: reg->F = (uint8_t)alu_add[lf->c][lf->a][lf->n]; break;
+		case LF_SUB: reg->F = (uint8_t)alu_sub[lf->c][lf->a][lf->n]; break;
+		case LF_AND: reg->F = lf->res ? FLAG_H : FLAG_Z | FLAG_H; break;
+		case LF_OR: reg->F = lf->res ? 0 : FLAG_Z; break;
+		case LF_INC: reg->F = (reg->F & FLAG_C) | alu_inc[lf->res]; break;
+		case LF_DEC: reg->F = (reg->F & FLAG_C) | alu_dec[lf->res]; break;
+	}
+	lf->op = LF_NONE;
+}
+
+#define FLAGS() (lf.op ? lazy_flags(&reg, &lf) : (void)0)
+#define FZ (lf.op ? !lf.res : reg.F_Z)
+#define FC (FLAGS(), reg.F_C)
+#define LAZY(o, x, y, cin, r) (lf.op = (o), lf.a = (x), lf.n = (y), lf.c = (cin), lf.res = (r))
+
+#define DO_ADD(n) do { uint8_t n_ = (n); LAZY(LF_ADD, reg.A, n_, 0, reg.A + n_); reg.A = lf.res; } while(0)
+#define DO_ADC(n) do { uint8_t n_ = (n), c_ = FC; LAZY(LF_ADD, reg.A, n_, c_, reg.A + n_ + c_); reg.A = lf.res; } while(0)
+#define DO_SUB(n) do { uint8_t n_ = (n); LAZY(LF_SUB, reg.A, n_, 0, reg.A - n_); reg.A = lf.res; } while(0)
+#define DO_SBC(n) do { uint8_t n_ = (n), c_ = FC; LAZY(LF_SUB, reg.A, n_, c_, reg.A - n_ - c_); reg.A = lf.res; } while(0)
+#define DO_AND(n) do { reg.A &= (n); LAZY(LF_AND, 0, 0, 0, reg.A); } while(0)
+#define DO_XOR(n) do { reg.A ^= (n); LAZY(LF_OR, 0, 0, 0, reg.A); } while(0)
+#define DO_OR(n) do { reg.A |= (n); LAZY(LF_OR, 0, 0, 0, reg.A); } while(0)
+#define DO_CP(n) do { uint8_t n_ = (n); LAZY(LF_SUB, reg.A, n_, 0, reg.A - n_); } while(0)
+/* INC and DEC take the already updated value and keep C */
+#define DO_INC(n) do { FLAGS(); lf.res = (n); lf.op = LF_INC; } while(0)
+#define DO_DEC(n) do { FLAGS(); lf.res = (n); lf.op = LF_DEC; } while(0)
+#else
+#define FLAGS() ((void)0)
+#define FZ (reg.F_Z)
+#define FC (reg.F_C)
+
+#define DO_ADD(n) ADD(&reg, (n))
+#define DO_ADC(n) ADC(&reg, (n))
+#define DO_SUB(n) SUB(&reg, (n))
+#define DO_SBC(n) SBC(&reg, (n))
+#define DO_AND(n) AND(&reg, (n))
+#define DO_XOR(n) XOR(&reg, (n))
+#define DO_OR(n) OR(&reg, (n))
+#define DO_CP(n) CP(&reg, (n))
+#define DO_INC(n) INC(&reg, (n))
+#define DO_DEC(n) DEC(&reg, (n))
+#endif
+
+#define JR_IF(cond) do { int8_t n = FETCH8(); if(cond) { reg.PC += n; } } while(0)
+#define JP_IF(cond) do { uint16_t a = FETCH16(); if(cond) { reg.PC = a; } } while(0)
+#define CALL_IF(cond) do { uint16_t a = FETCH16(); if(cond) { PUSH(reg.PC); reg.PC = a; } } while(0)
+#define RET_IF(cond) do { if(cond) { POP(reg.PC); } } while(0)
+
+static inline uint8_t cb_get(struct gb *gb, struct registers *reg, uint8_t i) {
+	switch(i) {
+		case 0: return reg->B;
+		case 1: return reg->C;
+		case 2: return reg->D;
+		case 3: return reg->E;
+		case 4: return reg->H;
+		case 5: return reg->L;
+		case 6: return read(gb, reg->HL);
+		default: return reg->A;
+	}
+}
+
+static inline void cb_set(struct gb *gb, struct registers *reg, uint8_t i, uint8_t n) {
+	switch(i) {
+		case 0: reg->B = n; break;
+		case 1: reg->C = n; break;
+		case 2: reg->D = n; break;
+		case 3: reg->E = n; break;
+		case 4: reg->H = n; break;
+		case 5: reg->L = n; break;
+		case 6: write(gb, reg->HL, n); break;
+		default: reg->A = n; break;
+	}
+}
+
+void cpu_run(struct gb *gb) {
+	struct registers reg = gb->r;
+	uint64_t instrs = gb->instr_counter;
+#ifdef LAZY_FLAGS
+	struct lazy lf = { LF_NONE };
+#endif
+	
+	do {
+		uint8_t op = FETCH8();
+		switch(op) {
+			case 0x00: break;
+			case 0x01: reg.BC = FETCH16(); break;
+			case 0x02: write(gb, reg.BC, reg.A); break;
+			case 0x03: reg.BC += 1; break;
+			case 0x04: DO_INC(++reg.B); break;
+			case 0x05: DO_DEC(--reg.B); break;
+			case 0x06: reg.B = FETCH8(); break;
+			case 0x07: FLAGS(); ROT_A(&reg, ALU_RLC); break;
+			case 0x08: write16(gb, FETCH16(), reg.SP); break;
+			case 0x09: FLAGS(); ADD_HL(&reg, reg.BC); break;
+			case 0x0A: reg.A = read(gb, reg.BC); break;
+			case 0x0B: reg.BC -= 1; break;
+			case 0x0C: DO_INC(++reg.C); break;
+			case 0x0D: DO_DEC(--reg.C); break;
+			case 0x0E: reg.C = FETCH8(); break;
+			case 0x0F: FLAGS(); ROT_A(&reg, ALU_RRC); break;
+			
+			case 0x10: break; /* STOP */
+			case 0x11: reg.DE = FETCH16(); break;
+			case 0x12: write(gb, reg.DE, reg.A); break;
+			case 0x13: reg.DE += 1; break;
+			case 0x14: DO_INC(++reg.D); break;
+			case 0x15: DO_DEC(--reg.D); break;
+			case 0x16: reg.D = FETCH8(); break;
+			case 0x17: FLAGS(); ROT_A(&reg, ALU_RL); break;
+			case 0x18: JR_IF(1); break;
+			case 0x19: FLAGS(); ADD_HL(&reg, reg.DE); break;
+			case 0x1A: reg.A = read(gb, reg.DE); break;
+			case 0x1B: reg.DE -= 1; break;
+			case 0x1C: DO_INC(++reg.E); break;
+			case 0x1D: DO_DEC(--reg.E); break;
+			case 0x1E: reg.E = FETCH8(); break;
+			case 0x1F: FLAGS(); ROT_A(&reg, ALU_RR); break;
+			
+			case 0x20: JR_IF(!FZ); break;
+			case 0x21: reg.HL = FETCH16(); break;
+			case 0x22: write(gb, reg.HL++, reg.A); break;
+			case 0x23: reg.HL += 1; break;
+			case 0x24: DO_INC(++reg.H); break;
+			case 0x25: DO_DEC(--reg.H); break;
+			case 0x26: reg.H = FETCH8(); break;
+			case 0x27: FLAGS(); DAA_r(&reg); break;
+			case 0x28: JR_IF(FZ); break;
+			case 0x29: FLAGS(); ADD_HL(&reg, reg.HL); break;
+			case 0x2A: reg.A = read(gb, reg.HL++); break;
+			case 0x2B: reg.HL -= 1; break;
+			case 0x2C: DO_INC(++reg.L); break;
+			case 0x2D: DO_DEC(--reg.L); break;
+			case 0x2E: reg.L = FETCH8(); break;
+			case 0x2F:
+				FLAGS();
+				reg.F_N = 1;
+				reg.F_H = 1;
+				reg.A ^= 0xFF;
+				break;
+				
+			case 0x30: JR_IF(!FC); break;
+			case 0x31: reg.SP = FETCH16(); break;
+			case 0x32: write(gb, reg.HL--, reg.A); break;
+			case 0x33: reg.SP += 1; break;
+			case 0x34: {
+				register uint8_t tmp = read(gb, reg.HL) + 1;
+				write(gb, reg.HL, tmp);
+				DO_INC(tmp);
+				break;
+			}
+			case 0x35: {
+				register uint8_t tmp = read(gb, reg.HL) - 1;
+				write(gb, reg.HL, tmp);
+				DO_DEC(tmp);
+				break;
+			}
+			case 0x36: write(gb, reg.HL, FETCH8()); break;
+			case 0x37:
+				FLAGS();
+				reg.F_N = reg.F_H = 0;
+				reg.F_C = 1;
+				break;
+			case 0x38: JR_IF(FC); break;
+			case 0x39: FLAGS(); ADD_HL(&reg, reg.SP); break;
+			case 0x3A: reg.A = read(gb, reg.HL--); break;
+			case 0x3B: reg.SP -= 1; break;
+			case 0x3C: DO_INC(++reg.A); break;
+			case 0x3D: DO_DEC(--reg.A); break;
+			case 0x3E: reg.A = FETCH8(); break;
+			case 0x3F:
+				FLAGS();
+				reg.F_N = reg.F_H = 0;
+				reg.F_C ^= 1;
+				break;
+				
+			case 0x40: /* LD B,B doubles as the mooneye breakpoint */
+				if(gb->stop_ldbb) {
+					FLAGS();
+					gb->r = reg;
+					cpu_ldbb(gb);
+				}
+				break;
+			case 0x41: reg.B = reg.C; break;
+			case 0x42: reg.B = reg.D; break;
+			case 0x43: reg.B = reg.E; break;
+			case 0x44: reg.B = reg.H; break;
+			case 0x45: reg.B = reg.L; break;
+			case 0x46: reg.B = read(gb, reg.HL); break;
+			case 0x47: reg.B = reg.A; break;
+			ROW(0x48, LD_C)
+			ROW(0x50, LD_D)
+			ROW(0x58, LD_E)
+			ROW(0x60, LD_H)
+			ROW(0x68, LD_L)
+			
+			case 0x70: write(gb, reg.HL, reg.B); break;
+			case 0x71: write(gb, reg.HL, reg.C); break;
+			case 0x72: write(gb, reg.HL, reg.D); break;
+			case 0x73: write(gb, reg.HL, reg.E); break;
+			case 0x74: write(gb, reg.HL, reg.H); break;
+			case 0x75: write(gb, reg.HL, reg.L); break;
+			case 0x76: cpu_halt(gb); break;
+			case 0x77: write(gb, reg.HL, reg.A); break;
+			
+			ROW(0x78, LD_A)
+			ROW(0x80, DO_ADD)
+			ROW(0x88, DO_ADC)
+			ROW(0x90, DO_SUB)
+			ROW(0x98, DO_SBC)
+			ROW(0xA0, DO_AND)
+			ROW(0xA8, DO_XOR)
+			ROW(0xB0, DO_OR)
+			ROW(0xB8, DO_CP)
+			
+			case 0xC0: RET_IF(!FZ); break;
+			case 0xC1: POP(reg.BC); break;
+			case 0xC2: JP_IF(!FZ); break;
+			case 0xC3: reg.PC = FETCH16(); break;
+			case 0xC4: CALL_IF(!FZ); break;
+			case 0xC5: PUSH(reg.BC); break;
+			case 0xC6: DO_ADD(FETCH8()); break;
+			case 0xC7: PUSH(reg.PC); reg.PC = 0x00; break;
+			case 0xC8: RET_IF(FZ); break;
+			case 0xC9: POP(reg.PC); break;
+			case 0xCA: JP_IF(FZ); break;
+			case 0xCB: {
+				uint8_t cb = FETCH8();
+				FLAGS();
+				uint8_t b = (cb >> 3) & 7;
+				uint8_t n = cb_get(gb, &reg, cb & 7);
+				switch(cb >> 3) {
+					case 0: n = RLC_n(&reg, n); break;
+					case 1: n = RRC_n(&reg, n); break;
+					case 2: n = RL_n(&reg, n); break;
+					case 3: n = RR_n(&reg, n); break;
+					case 4: n = SLA_n(&reg, n); break;
+					case 5: n = SRA_n(&reg, n); break;
+					case 6: n = SWAP(&reg, n); break;
+					case 7: n = SRL_n(&reg, n); break;
+					default:
+						if(cb < 0x80) { /* BIT */
+							BIT_b_r(&reg, b, n);
+							goto cb_done;
+						}
+						if(cb < 0xC0) { /* RES */
+							n &= ~(1 << b);
+						} else { /* SET */
+							n |= 1 << b;
+						}
+						break;
+				}
+				cb_set(gb, &reg, cb & 7, n);
+cb_done:
+				gb->cycle_counter += instr_cb_timing[cb] << 2;
+				break;
+			}
+			case 0xCC: CALL_IF(FZ); break;
+			case 0xCD: CALL_IF(1); break;
+			case 0xCE: DO_ADC(FETCH8()); break;
+			case 0xCF: PUSH(reg.PC); reg.PC = 0x08; break;
+			
+			case 0xD0: RET_IF(!FC); break;
+			case 0xD1: POP(reg.DE); break;
+			case 0xD2: JP_IF(!FC); break;
+			case 0xD4: CALL_IF(!FC); break;
+			case 0xD5: PUSH(reg.DE); break;
+			case 0xD6: DO_SUB(FETCH8()); break;
+			case 0xD7: PUSH(reg.PC); reg.PC = 0x10; break;
+			case 0xD8: RET_IF(FC); break;
+			case 0xD9: POP(reg.PC); cpu_ime(gb, 1); break; /* RETI */
+			case 0xDA: JP_IF(FC); break;
+			case 0xDC: CALL_IF(FC); break;
+			case 0xDE: DO_SBC(FETCH8()); break;
+			case 0xDF: PUSH(reg.PC); reg.PC = 0x18; break;
+			
+			case 0xE0: write(gb, 0xFF00 + FETCH8(), reg.A); break;
+			case 0xE1: POP(reg.HL); break;
+			case 0xE2: write(gb, reg.C + 0xFF00, reg.A); break;
+			case 0xE5: PUSH(reg.HL); break;
+			case 0xE6: DO_AND(FETCH8()); break;
+			case 0xE7: PUSH(reg.PC); reg.PC = 0x20; break;
+			case 0xE8: FLAGS(); reg.SP = SP_n(&reg, FETCH8()); break;
+			case 0xE9: reg.PC = reg.HL; break;
+			case 0xEA: write(gb, FETCH16(), reg.A); break;
+			case 0xEE: DO_XOR(FETCH8()); break;
+			case 0xEF: PUSH(reg.PC); reg.PC = 0x28; break;
+			
+			case 0xF0: reg.A = read(gb, 0xFF00 + FETCH8()); break;
+			case 0xF1: FLAGS(); POP(reg.AF); reg.AF &= 0xFFF0; break;
+			case 0xF2: reg.A = read(gb, reg.C + 0xFF00); break;
+			case 0xF3: cpu_ime(gb, 0); break; /* DI */
+			case 0xF5: FLAGS(); PUSH(reg.AF); break;
+			case 0xF6: DO_OR(FETCH8()); break;
+			case 0xF7: PUSH(reg.PC); reg.PC = 0x30; break;
+			case 0xF8: FLAGS(); reg.HL = SP_n(&reg, FETCH8()); break;
+			case 0xF9: reg.SP = reg.HL; break;
+			case 0xFA: reg.A = read(gb, FETCH16()); break;
+			case 0xFB: cpu_ei(gb); break; /* EI */
+			case 0xFE: DO_CP(FETCH8()); break;
+			case 0xFF: PUSH(reg.PC); reg.PC = 0x38; break;
+			
+			default: /* missing opcode */
+				break;
+		}
+		gb->cycle_counter += instr_timing[op] << 2;
+		++instrs;
+	} while(gb->cycle_counter < gb->until);
+	
+	FLAGS();
+	gb->r = reg;
+	gb->instr_counter = instrs;
+}
+
+void step(struct gb *gb) {
+	if(cpu_between(gb, gb->cycle_counter + 4)) {
+		return;
+	}
+	gb->until = 0;
+	cpu_run(gb);
+}
+
+#endif /* CORE_SWITCH */
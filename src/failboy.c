@@ -16,16 +16,143 @@
 #include "failboy.h"
 #include "files.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+	fprintf(stderr,
+		"usage: failboy [--jit] [rom]\n"
+		"       failboy --aot out.c rom...\n"
+		"       failboy --batch manifest [--jit] [-j threads] [-o results.jsonl]\n"
+		"       failboy --bench rom [--jit] [--frames N | --cycles N] [--trials N] [--warmup N]\n"
+		"       failboy --lockstep rom [--refill] [--frames N | --cycles N]\n"
+		"       failboy --opbench\n"
+		"       failboy --pairs rom [--frames N | --cycles N]\n"
+		"       failboy --selftest\n"
+		"       failboy --verify-render-skip rom [--frames N]\n");
+}
 
 int main(int argc, char *argv[]) {
-	cart_load("tests/cpu_instrs.gb");
-	mem_alloc();
-	cpu_bios_init();
-	for(uint32_t i = 0; i < 28000000; ++i) {
-		step();
+	const char *rom = "tests/cpu_instrs.gb";
+	const char *manifest = NULL;
+	const char *output = NULL;
+	const char *aot = NULL;
+	const char **roms = calloc(argc, sizeof(char *));
+	unsigned nroms = 0;
+	unsigned threads = 0;
+	int bench = 0;
+	int lockstep = 0;
+	int refill = 0;
+	int pairs = 0;
+	int verify_skip = 0;
+	int jit = 0;
+	uint64_t budget = 600;
+	int frames = 1;
+	unsigned trials = 5;
+	unsigned warmup = 1;
+	
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "--batch") && i + 1 < argc) {
+			manifest = argv[++i];
+		} else if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if(!strcmp(argv[i], "--aot") && i + 1 < argc) {
+			aot = argv[++i];
+		} else if(!strcmp(argv[i], "--bench")) {
+			bench = 1;
+		} else if(!strcmp(argv[i], "--lockstep")) {
+			lockstep = 1;
+		} else if(!strcmp(argv[i], "--refill")) {
+			refill = 1;
+		} else if(!strcmp(argv[i], "--pairs")) {
+			pairs = 1;
+		} else if(!strcmp(argv[i], "--verify-render-skip")) {
+			verify_skip = 1;
+		} else if(!strcmp(argv[i], "--jit")) {
+			jit = 1;
+		} else if(!strcmp(argv[i], "--opbench")) {
+			return opbench_run(stdout) ? 1 : 0;
+		} else if(!strcmp(argv[i], "--selftest")) {
+			return alu_selftest(stdout) ? 1 : 0;
+		} else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+			budget = strtoull(argv[++i], NULL, 0);
+			frames = 1;
+		} else if(!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+			budget = strtoull(argv[++i], NULL, 0);
+			frames = 0;
+		} else if(!strcmp(argv[i], "--trials") && i + 1 < argc) {
+			trials = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if(argv[i][0] == '-') {
+			usage();
+			return 1;
+		} else {
+			rom = roms[nroms++] = argv[i];
+		}
+	}
+	
+	if(aot) {
+		int ret = nroms ? aot_generate(aot, roms, nroms) : -1;
+		if(!nroms) {
+			usage();
+		}
+		free(roms);
+		return ret ? 1 : 0;
+	}
+	free(roms);
+	
+	if(manifest) {
+		FILE *out = output ? fopen(output, "w") : stdout;
+		int ret;
+		if(out == NULL) {
+			perror(output);
+			return 1;
+		}
+		ret = batch_run(manifest, threads, jit, out);
+		if(out != stdout) {
+			fclose(out);
+		}
+		return ret ? 1 : 0;
+	}
+	
+	if(bench) {
+		return bench_run(rom, budget, frames, trials, warmup, jit, stdout) ? 1 : 0;
+	}
+	
+	if(pairs) {
+		return pairs_run(rom, frames ? budget * FRAME_CYCLES : budget, stdout) ? 1 : 0;
+	}
+	
+	if(lockstep) {
+		return jit_lockstep(rom, frames ? budget * FRAME_CYCLES : budget, refill, stdout) ? 1 : 0;
+	}
+	
+	if(verify_skip) {
+		return video_verify_skip(rom, frames ? budget : budget / FRAME_CYCLES, stdout) ? 1 : 0;
+	}
+	
+	struct gb *gb = gb_alloc();
+	if(cart_load(gb, rom)) {
+		fprintf(stderr, "%s: could not load rom\n", rom);
+		gb_free(gb);
+		return 1;
+	}
+	if(jit && jit_enable(gb)) {
+		fprintf(stderr, "no recompiler in this build, interpreting\n");
+	}
+	serial_stop_tests(gb);
+	cpu_bios_init(gb);
+	/* one minute of emulated time, or until the test rom is done */
+	uint32_t serial_pos = 0;
+	char serial[SERIAL_BUF_SIZE];
+	for(unsigned i = 0; i < 60 * 60 && !gb->stop_reason; ++i) {
+		run_frame(gb);
+		fwrite(serial, 1, serial_read(gb, &serial_pos, serial, sizeof(serial)), stdout);
 	}
 	printf("\n\nEND OF LINE\n");
-	mem_free();
-	cart_free();
+	gb_free(gb);
 	return 0;
 }
@@ -17,29 +17,60 @@
 #define _FAILBOY_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 
 #define HIBYTE(a)	((a)>>8)
 #define LOBYTE(a)	((a)&0xff)
 
-typedef uint8_t (*read_f)(uint16_t);
-typedef void (*write_f)(uint16_t, uint8_t);
+/* Serial ring buffer, must be a power of two */
+#define SERIAL_BUF_SIZE	4096
+#define SERIAL_STOPS	4
 
-/* cart.c */
-void cart_load(const char *);
-void cart_free();
+/* Why a run stopped before using up its budget */
+enum {
+	STOP_NONE = 0,
+	STOP_PASSED,
+	STOP_FAILED
+};
 
-/* mem.c */
-void mem_alloc();
-void mem_free();
+/* Interrupt flag bits, IF and IE */
+enum {
+	INT_VBLANK = 0x01,
+	INT_STAT = 0x02,
+	INT_TIMER = 0x04,
+	INT_SERIAL = 0x08,
+	INT_JOYPAD = 0x10
+};
+
+/* Scheduled events, see sched.c. Events due on the same cycle fire in this
+ * order. */
+enum {
+	EVENT_PPU = 0,
+	EVENT_TIMER,
+	EVENT_SERIAL,
+	EVENT_DMA,
+	EVENTS
+};
+
+#define SCHED_NONE	0xFF
+
+/* Clock cycles, 4.194304 MHz */
+#define CPU_CLOCK	4194304
+#define LINE_CYCLES	456
+#define FRAME_CYCLES	70224
 
-extern uint8_t *oam;
-extern uint8_t *vram;
+/* The picture, one byte per pixel holding the shade 0-3 */
+#define SCREEN_WIDTH	160
+#define SCREEN_HEIGHT	144
+#define TILES	384
+#define OBJ_PER_LINE	10
 
-uint8_t read(uint16_t);
-uint16_t read16(uint16_t);
+struct gb;
 
-void write(uint16_t, uint8_t);
-void write16(uint16_t, uint16_t);
+typedef uint8_t (*read_f)(struct gb *, uint16_t);
+typedef void (*write_f)(struct gb *, uint16_t, uint8_t);
+typedef void (*serial_f)(struct gb *, uint8_t, void *);
 
 /* cpu.c */
 struct registers {
@@ -90,13 +121,259 @@ struct registers {
 	};
 };
 
-extern struct registers r;
-extern uint32_t cycle_counter;
+struct event {
+	uint64_t when;
+	uint8_t id;
+};
+
+struct sched {
+	struct event heap[EVENTS];
+	uint8_t pos[EVENTS]; /* heap index of each event, SCHED_NONE if unscheduled */
+	uint8_t count;
+};
+
+/* What a line of the picture was drawn from, see ppu_render() */
+struct line_key {
+	uint32_t sprites[OBJ_PER_LINE]; /* the sprites on it, in drawing order */
+	uint8_t nsprites;
+	uint8_t lcdc;
+	uint8_t scx;
+	uint8_t bg_y; /* SCY + LY */
+	uint8_t window; /* the window's line + 1, 0 if it is not on it */
+	uint8_t wx;
+	uint8_t bgp;
+	uint8_t obp0;
+	uint8_t obp1;
+	uint8_t drawn; /* the framebuffer line holds it */
+	uint64_t stamp; /* vram_stamp when it was drawn */
+};
+
+struct serial_stop {
+	const char *text;
+	uint8_t reason;
+};
+
+/*
+ * Everything that makes up one machine. Nothing in the emulator keeps state
+ * outside of this, so any number of them can run side by side.
+ */
+struct gb {
+	/* cpu.c */
+	struct registers r;
+	uint64_t cycle_counter;
+	uint64_t instr_counter;
+	/* the cores run while cycle_counter is below this */
+	uint64_t until;
+	uint8_t stop_reason;
+	/* stop on the mooneye LD B,B breakpoint */
+	uint8_t stop_ldbb;
+	uint8_t ime; /* interrupt master enable */
+	uint8_t ei; /* instructions left until EI sets IME, see cpu_between() */
+	uint8_t irq; /* IME && (IE & IF), an interrupt is due */
+	/* HALT waits for IE & IF with the core not running */
+	uint8_t halted;
+	/* the next opcode is fetched without moving PC */
+	uint8_t halt_bug;
+	/* operand bytes of the current instruction, fetched before its handler,
+	 * or of a whole fused group */
+	uint32_t imm;
+	
+	/* sched.c */
+	struct sched sched;
+	
+	/* block.c */
+	struct block_cache *blocks;
+	/* jit.c, NULL unless the recompiler is on */
+	struct jit *jit;
+	/* aot.c, the built in translation of the loaded rom if there is one */
+	const struct aot_rom *aot;
+	
+	/* mem.c */
+	uint8_t *wram;
+	uint8_t *hram;
+	uint8_t *oam;
+	uint8_t *vram;
+	/* 256 byte pages, NULL pages go through the handlers */
+	uint8_t *readpage[256];
+	uint8_t *writepage[256];
+	read_f readhandler[256];
+	write_f writehandler[256];
+	
+	/* cart.c */
+	uint8_t *rom;
+	uint8_t *ram;
+	unsigned int rom_size;
+	uint8_t cart_mode;
+	uint8_t rom_bank;
+	uint8_t ram_bank;
+	read_f ext0_read_f; /* 0000-3fff */
+	read_f ext1_read_f; /* 4000-7fff */
+	read_f ext2_read_f; /* a000-bfff */
+	write_f ext0_write_f; /* 0000-3fff */
+	write_f ext1_write_f; /* 4000-7fff */
+	write_f ext2_write_f; /* a000-bfff */
+	
+	/* io.c */
+	uint8_t iflag; /* IF */
+	uint8_t ie; /* IE */
+	/* DIV is the top of a counter started at div_base, TIMA is only brought
+	 * up to date when it is looked at, see timer_sync() */
+	uint64_t div_base;
+	uint64_t tima_time; /* the cycle tima was last synced to */
+	uint8_t tima;
+	uint8_t tma;
+	uint8_t tac;
+	uint8_t dma;
+	uint8_t dma_active; /* OAM reads as FF while set */
+	uint8_t sc;
+	uint8_t sb;
+	/* every byte sent over the link cable, serial_len counts them all */
+	uint8_t serial_buf[SERIAL_BUF_SIZE];
+	uint32_t serial_len;
+	struct serial_stop serial_stops[SERIAL_STOPS];
+	unsigned serial_nstops;
+	/* optional, called for every byte sent */
+	serial_f serial_out;
+	void *serial_arg;
+	
+	/* video.c */
+	uint8_t lcdc;
+	uint8_t stat; /* the mode is in the low two bits */
+	uint8_t scy;
+	uint8_t scx;
+	uint8_t ly;
+	uint8_t lyc;
+	uint8_t bgp;
+	uint8_t obp0;
+	uint8_t obp1;
+	uint8_t wy;
+	uint8_t wx;
+	uint8_t window_line; /* the window's own line counter */
+	/* when the current mode ends, UINT64_MAX with the LCD off, and when the
+	 * next vblank starts, see video_sync() */
+	uint64_t ppu_next;
+	uint64_t ppu_vblank;
+	/* every row of the 384 tiles at 8000-97FF decoded to colour numbers,
+	 * kept up to date by vram_write */
+	uint64_t tile_rows[TILES * 8];
+	/* counts the VRAM stores that changed something, each tile row and each
+	 * row of the two tile maps keep the count of their last change */
+	uint64_t vram_stamp;
+	uint64_t tile_stamp[TILES * 8];
+	uint64_t map_stamp[64];
+	/* lines that come out the same as last time are left as they are */
+	struct line_key lines[SCREEN_HEIGHT];
+	uint8_t lines_reused; /* so far this frame */
+	uint8_t lines_skipped; /* in the last frame, out of SCREEN_HEIGHT */
+	/* with render_skip only frames asked for with video_render_frame() are
+	 * drawn, render_now says if the current one is */
+	uint8_t render_skip;
+	uint8_t render_frame;
+	uint8_t render_now;
+	/* SCREEN_WIDTH * SCREEN_HEIGHT, each line is drawn as it ends, NULL to
+	 * not draw at all */
+	uint8_t *framebuffer;
+};
+
+/* aot.c */
+int aot_generate(const char *, const char *const *, unsigned);
+void aot_attach(struct gb *);
+
+/* bench.c */
+int bench_run(const char *, uint64_t, int, unsigned, unsigned, int, FILE *);
+
+/* pairs.c */
+int pairs_run(const char *, uint64_t, FILE *);
+
+/* opbench.c */
+int opbench_run(FILE *);
+
+/* batch.c */
+int batch_run(const char *, unsigned, int, FILE *);
+void json_string(FILE *, const char *, size_t);
+
+/* block.c */
+void block_alloc(struct gb *);
+void block_free(struct gb *);
+void block_flush(struct gb *);
+void block_invalidate(struct gb *, uint16_t);
+void block_exec(struct gb *);
+
+/* cart.c */
+int cart_load(struct gb *, const char *);
+void cart_free(struct gb *);
+void cart_mem_reset(struct gb *);
+
+/* cpu_alu.c */
+void alu_init();
+unsigned alu_selftest(FILE *);
+
+/* clock.c */
+uint64_t clock_ns();
+unsigned clock_cores();
+
+/* io.c */
+int serial_stop_on(struct gb *, const char *, uint8_t);
+void serial_stop_tests(struct gb *);
+unsigned serial_read(struct gb *, uint32_t *, char *, unsigned);
+
+/* jit.c */
+int jit_enable(struct gb *);
+void jit_free(struct gb *);
+int jit_lockstep(const char *, uint64_t, int, FILE *);
+
+/* sched.c */
+void sched_reset(struct gb *);
+void sched_add(struct gb *, unsigned, uint64_t);
+void sched_cancel(struct gb *, unsigned);
+uint64_t sched_next(struct gb *);
+void sched_run(struct gb *);
+
+/* mem.c */
+struct gb *gb_alloc();
+void gb_free(struct gb *);
+void mem_alloc(struct gb *);
+void mem_free(struct gb *);
+void mem_map_read(struct gb *, unsigned, unsigned, uint8_t *);
+void mem_map_write(struct gb *, unsigned, unsigned, uint8_t *);
+
+uint8_t read(struct gb *, uint16_t);
+uint16_t read16(struct gb *, uint16_t);
+
+void write(struct gb *, uint16_t, uint8_t);
+void write16(struct gb *, uint16_t, uint16_t);
+
+/* video.c */
+void video_init();
+void video_sync(struct gb *);
+void video_interrupts(struct gb *);
+void video_framebuffer(struct gb *, uint8_t *);
+void video_render_skip(struct gb *, int);
+void video_render_frame(struct gb *);
+int video_verify_skip(const char *, uint64_t, FILE *);
+
+/* cpu.c */
+/* The handlers take their operands from gb->imm, the core fetches them. */
+#define rpc8(gb) ((gb)->r.PC++, (uint8_t)(gb)->imm)
+#define rpc16(gb) ((gb)->r.PC += 2, (uint16_t)(gb)->imm)
+
+typedef int (*run_pred_f)(struct gb *, void *);
 
-#define rpc8() (read(r.PC++))
-#define rpc16() ((rpc8()) | (rpc8() << 8))
+extern const char *cpu_core;
 
-void cpu_bios_init();
-void step();
+void cpu_bios_init(struct gb *);
+void cpu_stop(struct gb *, uint8_t);
+void cpu_ldbb(struct gb *);
+void cpu_irq_update(struct gb *);
+void cpu_request(struct gb *, uint8_t);
+void cpu_ime(struct gb *, uint8_t);
+void cpu_ei(struct gb *);
+void cpu_halt(struct gb *);
+int cpu_between(struct gb *, uint64_t);
+void cpu_step(struct gb *);
+void step(struct gb *);
+uint64_t run_cycles(struct gb *, uint64_t);
+uint64_t run_frame(struct gb *);
+uint64_t run_until(struct gb *, run_pred_f, void *, uint64_t);
 
 #endif /* _FAILBOY_H_ */
@@ -13,8 +13,23 @@
  * GNU General Public License for more details.
  */
 
+/*
+ * The IO registers. The timer, serial transfers and OAM DMA each keep one
+ * deadline in the scheduler (sched.c) and do their work when it fires.
+ *
+ * The timer is not ticked at all. DIV and TIMA both run off the 16 bit
+ * divider, which is just the cycle count since it was last reset, so DIV
+ * is worked out when it is read and TIMA is caught up with the number of
+ * divider edges since it was last looked at. The only deadline the timer
+ * keeps is the next TIMA overflow, for the interrupt.
+ */
+
 #include "failboy.h"
-#include <stdio.h>
+#include <string.h>
+
+/* video.c */
+uint8_t video_read(struct gb *, uint16_t); /* FF40-FF4B */
+void video_write(struct gb *, uint16_t, uint8_t); /* FF40-FF4B */
 
 enum {
 	IO_P1 = 0xFF00,
@@ -25,30 +40,272 @@ enum {
 	IO_TMA = 0xFF06,
 	IO_TAC = 0xFF07,
 	IO_IF = 0xFF0F,
+	IO_LCDC = 0xFF40,
 	IO_DMA = 0xFF46,
+	IO_WX = 0xFF4B,
 	IO_IE = 0xFFFF
 };
 
-static uint8_t sb = 0;
+#define TAC_ON	0x04
+/* TIMA counts on the falling edge of a divider bit chosen by the low two TAC
+ * bits, so once every 1024, 16, 64 or 256 cycles, this is the log2 of that */
+static const uint8_t timer_shift[4] = { 10, 4, 6, 8 };
+
+/* 8 bits at 8192 Hz on the internal clock */
+#define SERIAL_CYCLES	(8 * (CPU_CLOCK / 8192))
+#define SC_START	0x80
+#define SC_INTERNAL	0x01
 
-uint8_t io_read(uint16_t address) {
+/* 160 bytes, one per machine cycle */
+#define DMA_CYCLES	(160 * 4)
+
+/* Registers a string that stops the run with reason once it is sent. */
+int serial_stop_on(struct gb *gb, const char *text, uint8_t reason) {
+	if(gb->serial_nstops == SERIAL_STOPS || strlen(text) > SERIAL_BUF_SIZE) {
+		return -1;
+	}
+	gb->serial_stops[gb->serial_nstops].text = text;
+	gb->serial_stops[gb->serial_nstops].reason = reason;
+	++gb->serial_nstops;
 	return 0;
 }
 
-void io_write(uint16_t address, uint8_t value) {
+/* The usual test rom conventions, blargg prints Passed or Failed over the
+ * link cable and mooneye uses the LD B,B breakpoint. */
+void serial_stop_tests(struct gb *gb) {
+	serial_stop_on(gb, "Passed", STOP_PASSED);
+	serial_stop_on(gb, "Failed", STOP_FAILED);
+	gb->stop_ldbb = 1;
+}
+
+/*
+ * Copies out what was sent since *pos and advances it. Anything that has
+ * already been overwritten in the ring buffer is skipped.
+ */
+unsigned serial_read(struct gb *gb, uint32_t *pos, char *out, unsigned len) {
+	unsigned count = 0;
+	if(gb->serial_len - *pos > SERIAL_BUF_SIZE) {
+		*pos = gb->serial_len - SERIAL_BUF_SIZE;
+	}
+	while(*pos != gb->serial_len && count < len) {
+		out[count++] = gb->serial_buf[*pos & (SERIAL_BUF_SIZE - 1)];
+		++*pos;
+	}
+	return count;
+}
+
+/* Does the ring buffer end with text? */
+static int serial_ends_with(struct gb *gb, const char *text) {
+	uint32_t len = strlen(text);
+	uint32_t start = gb->serial_len - len;
+	if(len > gb->serial_len) {
+		return 0;
+	}
+	for(uint32_t i = 0; i < len; ++i) {
+		if(gb->serial_buf[(start + i) & (SERIAL_BUF_SIZE - 1)] != (uint8_t)text[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void serial_send(struct gb *gb, uint8_t value) {
+	gb->serial_buf[gb->serial_len++ & (SERIAL_BUF_SIZE - 1)] = value;
+	if(gb->serial_out) {
+		gb->serial_out(gb, value, gb->serial_arg);
+	}
+	for(unsigned i = 0; i < gb->serial_nstops; ++i) {
+		if(serial_ends_with(gb, gb->serial_stops[i].text)) {
+			cpu_stop(gb, gb->serial_stops[i].reason);
+		}
+	}
+}
+
+/* A transfer on the internal clock is done, there is nobody on the other
+ * end so the byte coming back is FF. The byte going out was already taken
+ * when the transfer started. */
+void serial_event(struct gb *gb, uint64_t when) {
+	gb->sb = 0xFF;
+	gb->sc &= ~SC_START;
+	cpu_request(gb, INT_SERIAL);
+}
+
+/* The divider at cycle now. */
+static uint64_t timer_divider(struct gb *gb, uint64_t now) {
+	return now - gb->div_base;
+}
+
+/* Is the divider bit TIMA counts on set? It is always clear while TAC is off,
+ * which is what makes the DIV and TAC write glitches below work. */
+static int timer_bit(struct gb *gb, uint8_t tac, uint64_t now) {
+	return (tac & TAC_ON) && timer_divider(gb, now) >> (timer_shift[tac & 3] - 1) & 1;
+}
+
+/* Adds count to TIMA, reloading from TMA and raising the interrupt if it
+ * overflows. */
+static void timer_count(struct gb *gb, uint64_t count) {
+	unsigned left = 0x100 - gb->tima;
+	if(count < left) {
+		gb->tima += count;
+		return;
+	}
+	count -= left;
+	gb->tima = gb->tma;
+	cpu_request(gb, INT_TIMER);
+	gb->tima += count % (0x100 - gb->tma);
+}
+
+/* Catches TIMA up with every falling edge of its divider bit up to now. A
+ * read can run ahead of the overflow event, which then has nothing to do. */
+static void timer_sync(struct gb *gb, uint64_t now) {
+	if(now < gb->tima_time) {
+		return;
+	}
+	if(gb->tac & TAC_ON) {
+		uint8_t shift = timer_shift[gb->tac & 3];
+		timer_count(gb, (timer_divider(gb, now) >> shift) - (timer_divider(gb, gb->tima_time) >> shift));
+	}
+	gb->tima_time = now;
+}
+
+/* Puts the next overflow in the scheduler, must be synced first. */
+static void timer_schedule(struct gb *gb) {
+	uint8_t shift = timer_shift[gb->tac & 3];
+	uint64_t edge;
+	if(!(gb->tac & TAC_ON)) {
+		sched_cancel(gb, EVENT_TIMER);
+		return;
+	}
+	edge = (timer_divider(gb, gb->tima_time) >> shift) + (0x100 - gb->tima);
+	sched_add(gb, EVENT_TIMER, gb->div_base + (edge << shift));
+}
+
+/* TIMA overflowed, syncing to the deadline does the reload and interrupt. */
+void timer_event(struct gb *gb, uint64_t when) {
+	timer_sync(gb, when);
+	timer_schedule(gb);
+}
+
+/* Resetting the divider drops its bits to 0, if the one TIMA counts on was
+ * set that is a falling edge and TIMA counts once more. */
+static void timer_write_div(struct gb *gb) {
+	uint64_t now = gb->cycle_counter;
+	timer_sync(gb, now);
+	if(timer_bit(gb, gb->tac, now)) {
+		timer_count(gb, 1);
+	}
+	gb->div_base = now;
+	timer_schedule(gb);
+}
+
+/* The TAC write glitch, TIMA sees the AND of the enable bit and its divider
+ * bit, so switching either from a set bit to a clear one counts once. */
+static void timer_write_tac(struct gb *gb, uint8_t value) {
+	uint64_t now = gb->cycle_counter;
+	timer_sync(gb, now);
+	if(timer_bit(gb, gb->tac, now) && !timer_bit(gb, value, now)) {
+		timer_count(gb, 1);
+	}
+	gb->tac = value & 7;
+	timer_schedule(gb);
+}
+
+void dma_event(struct gb *gb, uint64_t when) {
+	gb->dma_active = 0;
+}
+
+/* Copies the OAM in one go, the CPU only sees it as busy until the end. */
+static void dma_start(struct gb *gb, uint8_t value) {
+	uint16_t src = value << 8;
+	video_sync(gb);
+	gb->dma = value;
+	gb->dma_active = 0;
+	for(unsigned i = 0; i < 160; ++i) {
+		gb->oam[i] = read(gb, src + i);
+	}
+	gb->dma_active = 1;
+	sched_add(gb, EVENT_DMA, gb->cycle_counter + DMA_CYCLES);
+}
+
+uint8_t io_read(struct gb *gb, uint16_t address) {
+	if(address >= IO_LCDC && address <= IO_WX && address != IO_DMA) {
+		return video_read(gb, address);
+	}
+	switch(address) {
+		case IO_P1:
+			return 0xFF; /* no buttons pressed */
+		case IO_SB:
+			return gb->sb;
+		case IO_SC:
+			return gb->sc | 0x7E;
+		case IO_DIV:
+			return timer_divider(gb, gb->cycle_counter) >> 8;
+		case IO_TIMA:
+			timer_sync(gb, gb->cycle_counter);
+			return gb->tima;
+		case IO_TMA:
+			return gb->tma;
+		case IO_TAC:
+			return gb->tac | 0xF8;
+		case IO_IF:
+			video_sync(gb);
+			return gb->iflag | 0xE0;
+		case IO_DMA:
+			return gb->dma;
+		case IO_IE:
+			return gb->ie;
+	}
+	return 0xFF;
+}
+
+void io_write(struct gb *gb, uint16_t address, uint8_t value) {
+	if(address >= IO_LCDC && address <= IO_WX && address != IO_DMA) {
+		video_write(gb, address, value);
+		return;
+	}
 	switch(address) {
 		/* link cable for console ! :D */
 		case IO_SB:
-			sb = value;
+			gb->sb = value;
 			break;
 		case IO_SC:
-			/* transfer the data */
-			if(value == 0x81) {
-				printf("%c", sb);
+			gb->sc = value & (SC_START | SC_INTERNAL);
+			if((value & (SC_START | SC_INTERNAL)) == (SC_START | SC_INTERNAL)) {
+				serial_send(gb, gb->sb);
+				sched_add(gb, EVENT_SERIAL, gb->cycle_counter + SERIAL_CYCLES);
+			} else {
+				sched_cancel(gb, EVENT_SERIAL);
 			}
 			break;
+		case IO_DIV:
+			timer_write_div(gb);
+			break;
+		case IO_TIMA:
+			timer_sync(gb, gb->cycle_counter);
+			gb->tima = value;
+			timer_schedule(gb);
+			break;
+		case IO_TMA:
+			timer_sync(gb, gb->cycle_counter);
+			gb->tma = value;
+			break;
+		case IO_TAC:
+			timer_write_tac(gb, value);
+			break;
+		case IO_IF:
+			video_sync(gb);
+			gb->iflag = value & 0x1F;
+			cpu_irq_update(gb);
+			break;
+		case IO_DMA:
+			dma_start(gb, value);
+			break;
+		case IO_IE:
+			gb->ie = value;
+			cpu_irq_update(gb);
+			video_interrupts(gb);
+			break;
 		default:
-			//printf("WRITE %02x -> %04x\n", value, address);
 			break;
 	}
 }
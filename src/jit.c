@@ -0,0 +1,633 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * x86-64 recompiler for the table core. Hot ROM blocks from block.c are
+ * translated into one native function each. The simple register ops, loads
+ * and stores through BC/DE/HL and the 8-bit ALU are emitted inline; everything
+ * else becomes a direct call to its handler from instr_map, so the handlers
+ * stay the reference for every opcode. A, F and HL are kept in host registers
+ * for the whole block and only written back to gb->r before a handler call
+ * and when the block returns; the rest of the guest state stays in gb->r and
+ * is worked on in place with rbx holding gb.
+ *
+ * Inline loads and stores go straight through the page table and only call
+ * read()/write() for pages without a direct mapping, which also keeps the
+ * self modifying code checks of block.c working. RAM blocks are never
+ * compiled.
+ *
+ * After every instruction the code bumps cycle_counter and instr_counter and
+ * leaves once until is reached, exactly like block_exec(), so a compiled run
+ * stops on the same instruction as an interpreted one. jit_lockstep() checks
+ * that against the interpreter.
+ */
+
+#define _DEFAULT_SOURCE
+#include "block.h"
+#include "cpu_alu.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(CORE_SWITCH)
+#define JIT_X64
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#define JIT_SIZE	(4 << 20)
+#define JIT_BLOCK_MAX	4096 /* more than a block of the longest ops can take */
+/* the buffer lockstep uses with refill, small enough to fill up many times */
+#define JIT_REFILL_SIZE	(2 * JIT_BLOCK_MAX)
+/* lockstep compares state every this many cycles, odd so the stops move
+ * around inside loops, and ram every LOCKSTEP_RAM of those */
+#define LOCKSTEP_CYCLES	97
+#define LOCKSTEP_RAM	16
+
+struct jit {
+	uint8_t *mem;
+	size_t size; /* how much of mem is used before starting over */
+	size_t used;
+	unsigned resets;
+};
+
+#ifdef JIT_X64
+
+#define R(field) ((int32_t)(offsetof(struct gb, r) + offsetof(struct registers, field)))
+#define G(field) ((int32_t)offsetof(struct gb, field))
+
+/* B C D E H L (HL) A, as in the opcodes; H, L and A are pinned, see below */
+static const int32_t reg8[8] = { R(B), R(C), R(D), R(E), R(H), R(L), -1, R(A) };
+/* BC DE HL SP */
+static const int32_t reg16[4] = { R(BC), R(DE), R(HL), R(SP) };
+
+/*
+ * A, F and HL stay in r12, r13 and r14 for the whole block, zero extended.
+ * These are callee saved, so they survive read()/write() (which never look
+ * at gb->r) and only go back to gb->r around a handler call and on the way
+ * out. The numbers are the low three bits, the REX prefix adds the rest.
+ */
+#define PIN_A	4
+#define PIN_F	5
+#define PIN_HL	6
+enum { REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, REG_HLP, REG_A };
+
+/* emit cursor, one per compile */
+struct emit {
+	uint8_t *p;
+	uint8_t *exits[BLOCK_OPS];
+	unsigned nexits;
+};
+
+static void e8(struct emit *e, uint8_t b) {
+	*e->p++ = b;
+}
+
+static void e32(struct emit *e, uint32_t v) {
+	memcpy(e->p, &v, 4);
+	e->p += 4;
+}
+
+static void e64(struct emit *e, uint64_t v) {
+	memcpy(e->p, &v, 8);
+	e->p += 8;
+}
+
+/* ModRM for [rbx + disp32] with reg field r */
+static void mrm(struct emit *e, uint8_t r, int32_t disp) {
+	e8(e, 0x83 | r << 3);
+	e32(e, disp);
+}
+
+typedef void (*host_f)(void);
+
+/* mov rax, imm64; call rax */
+static void x_call(struct emit *e, host_f fn) {
+	uint64_t addr;
+	memcpy(&addr, &fn, 8);
+	e8(e, 0x48); e8(e, 0xB8); e64(e, addr);
+	e8(e, 0xFF); e8(e, 0xD0);
+}
+
+/* mov rdx, imm64 */
+static void x_rdx_ptr(struct emit *e, const void *p) {
+	e8(e, 0x48); e8(e, 0xBA); e64(e, (uint64_t)(uintptr_t)p);
+}
+
+/* first argument = gb */
+static void x_arg_gb(struct emit *e) {
+#ifdef _WIN32
+	e8(e, 0x48); e8(e, 0x89); e8(e, 0xD9); /* mov rcx, rbx */
+#else
+	e8(e, 0x48); e8(e, 0x89); e8(e, 0xDF); /* mov rdi, rbx */
+#endif
+}
+
+/* second argument = eax */
+static void x_arg2_eax(struct emit *e) {
+#ifdef _WIN32
+	e8(e, 0x89); e8(e, 0xC2); /* mov edx, eax */
+#else
+	e8(e, 0x89); e8(e, 0xC6); /* mov esi, eax */
+#endif
+}
+
+/* third argument = ecx */
+static void x_arg3_ecx(struct emit *e) {
+#ifdef _WIN32
+	e8(e, 0x41); e8(e, 0x89); e8(e, 0xC8); /* mov r8d, ecx */
+#else
+	e8(e, 0x89); e8(e, 0xCA); /* mov edx, ecx */
+#endif
+}
+
+/* guest register r (not (HL)) into eax (h = 0) or ecx (h = 1), zero extended */
+static void x_get8(struct emit *e, unsigned r, uint8_t h) {
+	switch(r) {
+		case REG_A:
+			e8(e, 0x41); e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xC0 | h << 3 | PIN_A); /* movzx h, r12b */
+			break;
+		case REG_L:
+			e8(e, 0x41); e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xC0 | h << 3 | PIN_HL); /* movzx h, r14b */
+			break;
+		case REG_H:
+			e8(e, 0x44); e8(e, 0x89); e8(e, 0xC0 | PIN_HL << 3 | h); /* mov h, r14d */
+			e8(e, 0xC1); e8(e, 0xE8 | h); e8(e, 0x08); /* shr h, 8 */
+			break;
+		default:
+			e8(e, 0x0F); e8(e, 0xB6); mrm(e, h, reg8[r]); /* movzx h, byte [r] */
+	}
+}
+
+/* low byte of eax (h = 0) or ecx (h = 1) into guest register r, may clobber h */
+static void x_set8(struct emit *e, unsigned r, uint8_t h) {
+	switch(r) {
+		case REG_A:
+			e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xC0 | PIN_A << 3 | h); /* movzx r12d, h8 */
+			break;
+		case REG_L:
+			e8(e, 0x41); e8(e, 0x88); e8(e, 0xC0 | h << 3 | PIN_HL); /* mov r14b, h8 */
+			break;
+		case REG_H:
+			e8(e, 0x41); e8(e, 0x81); e8(e, 0xE6); e32(e, 0xFF); /* and r14d, 0xFF */
+			e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xC0 | h << 3 | h); /* movzx h, h8 */
+			e8(e, 0xC1); e8(e, 0xE0 | h); e8(e, 0x08); /* shl h, 8 */
+			e8(e, 0x41); e8(e, 0x09); e8(e, 0xC0 | h << 3 | PIN_HL); /* or r14d, h */
+			break;
+		default:
+			e8(e, 0x88); mrm(e, h, reg8[r]); /* mov [r], h8 */
+	}
+}
+
+/* writes the pinned registers back to gb->r */
+static void x_spill(struct emit *e) {
+	e8(e, 0x44); e8(e, 0x88); mrm(e, PIN_A, R(A)); /* mov [A], r12b */
+	e8(e, 0x44); e8(e, 0x88); mrm(e, PIN_F, R(F)); /* mov [F], r13b */
+	e8(e, 0x66); e8(e, 0x44); e8(e, 0x89); mrm(e, PIN_HL, R(HL)); /* mov [HL], r14w */
+}
+
+/* and picks them up again */
+static void x_reload(struct emit *e) {
+	e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB6); mrm(e, PIN_A, R(A)); /* movzx r12d, byte [A] */
+	e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB6); mrm(e, PIN_F, R(F)); /* movzx r13d, byte [F] */
+	e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB7); mrm(e, PIN_HL, R(HL)); /* movzx r14d, word [HL] */
+}
+
+/* four pushes and the return address leave rsp 8 off for the calls */
+static void x_prologue(struct emit *e) {
+	e8(e, 0x53); /* push rbx */
+	e8(e, 0x41); e8(e, 0x54); /* push r12 */
+	e8(e, 0x41); e8(e, 0x55); /* push r13 */
+	e8(e, 0x41); e8(e, 0x56); /* push r14 */
+#ifdef _WIN32
+	e8(e, 0x48); e8(e, 0x83); e8(e, 0xEC); e8(e, 0x28); /* sub rsp, 32 + 8 */
+	e8(e, 0x48); e8(e, 0x89); e8(e, 0xCB); /* mov rbx, rcx */
+#else
+	e8(e, 0x48); e8(e, 0x83); e8(e, 0xEC); e8(e, 0x08); /* sub rsp, 8 */
+	e8(e, 0x48); e8(e, 0x89); e8(e, 0xFB); /* mov rbx, rdi */
+#endif
+	x_reload(e);
+}
+
+/* every exit lands here */
+static void x_epilogue(struct emit *e) {
+	x_spill(e);
+#ifdef _WIN32
+	e8(e, 0x48); e8(e, 0x83); e8(e, 0xC4); e8(e, 0x28); /* add rsp, 32 + 8 */
+#else
+	e8(e, 0x48); e8(e, 0x83); e8(e, 0xC4); e8(e, 0x08); /* add rsp, 8 */
+#endif
+	e8(e, 0x41); e8(e, 0x5E); /* pop r14 */
+	e8(e, 0x41); e8(e, 0x5D); /* pop r13 */
+	e8(e, 0x41); e8(e, 0x5C); /* pop r12 */
+	e8(e, 0x5B); /* pop rbx */
+	e8(e, 0xC3); /* ret */
+}
+
+/* add word [PC], n */
+static void x_pc_add(struct emit *e, uint8_t n) {
+	e8(e, 0x66); e8(e, 0x83); mrm(e, 0, R(PC)); e8(e, n);
+}
+
+/*
+ * Load or store through the page table. The address comes from the 16 bit
+ * register at ra, or from HL when ra is -1, the byte goes to or comes from
+ * guest register r.
+ */
+static void x_mem(struct emit *e, int store, int32_t ra, unsigned r) {
+	uint8_t *slow, *done;
+	if(ra < 0) {
+		e8(e, 0x41); e8(e, 0x0F); e8(e, 0xB7); e8(e, 0xC0 | PIN_HL); /* movzx eax, r14w */
+	} else {
+		e8(e, 0x0F); e8(e, 0xB7); mrm(e, 0, ra); /* movzx eax, word [ra] */
+	}
+	e8(e, 0x89); e8(e, 0xC1); /* mov ecx, eax */
+	e8(e, 0xC1); e8(e, 0xE9); e8(e, 0x08); /* shr ecx, 8 */
+	e8(e, 0x48); e8(e, 0x8B); e8(e, 0x94); e8(e, 0xCB); /* mov rdx, [rbx + rcx * 8 + page] */
+	e32(e, store ? G(writepage) : G(readpage));
+	e8(e, 0x48); e8(e, 0x85); e8(e, 0xD2); /* test rdx, rdx */
+	e8(e, 0x74); slow = e->p; e8(e, 0); /* jz slow */
+	e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xC0); /* movzx eax, al */
+	if(store) {
+		x_get8(e, r, 1);
+		e8(e, 0x88); e8(e, 0x0C); e8(e, 0x02); /* mov [rdx + rax], cl */
+	} else {
+		e8(e, 0x8A); e8(e, 0x04); e8(e, 0x02); /* mov al, [rdx + rax] */
+	}
+	e8(e, 0xEB); done = e->p; e8(e, 0); /* jmp done */
+	*slow = (uint8_t)(e->p - slow - 1);
+	x_arg2_eax(e);
+	if(store) {
+		x_get8(e, r, 1);
+		x_arg3_ecx(e);
+	}
+	x_arg_gb(e);
+	x_call(e, store ? (host_f)write : (host_f)read);
+	*done = (uint8_t)(e->p - done - 1);
+	if(!store) {
+		x_set8(e, r, 0);
+	}
+}
+
+/* INC r / DEC r, F from alu_inc/alu_dec keeping C */
+static void x_incdec(struct emit *e, int dec, unsigned r) {
+	x_get8(e, r, 0);
+	e8(e, 0xFE); e8(e, dec ? 0xC8 : 0xC0); /* inc/dec al */
+	x_rdx_ptr(e, dec ? alu_dec : alu_inc);
+	e8(e, 0x0F); e8(e, 0xB6); e8(e, 0x0C); e8(e, 0x02); /* movzx ecx, byte [rdx + rax] */
+	x_set8(e, r, 0);
+	e8(e, 0x41); e8(e, 0x80); e8(e, 0xE5); e8(e, FLAG_C); /* and r13b, FLAG_C */
+	e8(e, 0x41); e8(e, 0x08); e8(e, 0xCD); /* or r13b, cl */
+}
+
+/*
+ * The 8-bit ALU, alu is the row of the 0x80-0xBF block (ADD ADC SUB SBC AND
+ * XOR OR CP). The operand is guest register r, or imm when r is -1.
+ */
+static void x_alu(struct emit *e, unsigned alu, int r, uint8_t imm) {
+	if(alu >= 4 && alu <= 6) {
+		static const uint8_t op_reg[3] = { 0x20, 0x30, 0x08 }; /* and xor or r12b, cl */
+		static const uint8_t op_imm[3] = { 0xE4, 0xF4, 0xCC }; /* and xor or r12b, imm8 */
+		if(r < 0) {
+			e8(e, 0x41); e8(e, 0x80); e8(e, op_imm[alu - 4]); e8(e, imm);
+		} else {
+			x_get8(e, r, 1);
+			e8(e, 0x41); e8(e, op_reg[alu - 4]); e8(e, 0xC0 | 1 << 3 | PIN_A);
+		}
+		e8(e, 0x0F); e8(e, 0x94); e8(e, 0xC1); /* setz cl */
+		e8(e, 0xC0); e8(e, 0xE1); e8(e, 0x07); /* shl cl, 7 */
+		if(alu == 4) {
+			e8(e, 0x80); e8(e, 0xC9); e8(e, FLAG_H); /* or cl, FLAG_H */
+		}
+		e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xE9); /* movzx r13d, cl */
+		return;
+	}
+	e8(e, 0x44); e8(e, 0x89); e8(e, 0xE0); /* mov eax, r12d */
+	e8(e, 0xC1); e8(e, 0xE0); e8(e, 0x08); /* shl eax, 8 */
+	if(r < 0) {
+		e8(e, 0xB9); e32(e, imm); /* mov ecx, imm */
+	} else {
+		x_get8(e, r, 1);
+	}
+	e8(e, 0x09); e8(e, 0xC8); /* or eax, ecx */
+	if(alu == 1 || alu == 3) {
+		/* carry in picks the second half of the table */
+		e8(e, 0x44); e8(e, 0x89); e8(e, 0xE9); /* mov ecx, r13d */
+		e8(e, 0x83); e8(e, 0xE1); e8(e, FLAG_C); /* and ecx, FLAG_C */
+		e8(e, 0xC1); e8(e, 0xE1); e8(e, 0x0C); /* shl ecx, 12 */
+		e8(e, 0x09); e8(e, 0xC8); /* or eax, ecx */
+	}
+	x_rdx_ptr(e, alu < 2 ? &alu_add[0][0][0] : &alu_sub[0][0][0]);
+	e8(e, 0x0F); e8(e, 0xB7); e8(e, 0x04); e8(e, 0x42); /* movzx eax, word [rdx + rax * 2] */
+	e8(e, 0x44); e8(e, 0x0F); e8(e, 0xB6); e8(e, 0xE8); /* movzx r13d, al */
+	if(alu != 7) { /* CP only keeps F */
+		e8(e, 0xC1); e8(e, 0xE8); e8(e, 0x08); /* shr eax, 8 */
+		e8(e, 0x41); e8(e, 0x89); e8(e, 0xC0 | PIN_A); /* mov r12d, eax */
+	}
+}
+
+/* Emits one instruction inline, returns 0 if it has to go to its handler. */
+static int x_inline(struct emit *e, const struct block_op *o) {
+	uint8_t op = o->op;
+	uint8_t len = instr_length[op];
+	
+	if(op == 0x00) { /* NOP */
+		x_pc_add(e, 1);
+		return 1;
+	}
+	if(op >= 0x40 && op < 0x80 && op != 0x76 && op != 0x40) { /* LD r,r */
+		unsigned dst = (op >> 3) & 7, src = op & 7;
+		x_pc_add(e, 1);
+		if(src == REG_HLP) {
+			x_mem(e, 0, -1, dst);
+		} else if(dst == REG_HLP) {
+			x_mem(e, 1, -1, src);
+		} else {
+			x_get8(e, src, 0);
+			x_set8(e, dst, 0);
+		}
+		return 1;
+	}
+	if(op >= 0x80 && op < 0xC0 && (op & 7) != REG_HLP) { /* ALU A,r */
+		x_pc_add(e, 1);
+		x_alu(e, (op >> 3) & 7, op & 7, 0);
+		return 1;
+	}
+	if(op >= 0xC0 && (op & 7) == 6) { /* ALU A,n */
+		x_pc_add(e, len);
+		x_alu(e, (op >> 3) & 7, -1, (uint8_t)o->imm);
+		return 1;
+	}
+	if(op == 0x21) { /* LD HL,nn */
+		x_pc_add(e, len);
+		e8(e, 0x41); e8(e, 0xB8 | PIN_HL); e32(e, o->imm & 0xFFFF); /* mov r14d, imm */
+		return 1;
+	}
+	if(op < 0x40) {
+		unsigned r = (op >> 3) & 7;
+		switch(op & 0xF) {
+			case 0x2: case 0xA: /* LD (rr),A and LD A,(rr), HL goes up or down after */
+				x_pc_add(e, 1);
+				x_mem(e, !(op & 8), op >= 0x20 ? -1 : reg16[op >> 4], REG_A);
+				if(op >= 0x20) {
+					e8(e, 0x66); e8(e, 0x41); e8(e, 0xFF); /* inc/dec r14w */
+					e8(e, (op >= 0x30 ? 0xC8 : 0xC0) | PIN_HL);
+				}
+				return 1;
+			case 0x3: case 0xB: /* INC rr / DEC rr */
+				x_pc_add(e, 1);
+				if(op >> 4 == 2) {
+					e8(e, 0x66); e8(e, 0x41); e8(e, 0xFF); /* inc/dec r14w */
+					e8(e, (op & 8 ? 0xC8 : 0xC0) | PIN_HL);
+				} else {
+					e8(e, 0x66); e8(e, 0xFF); mrm(e, (op & 8) != 0, reg16[op >> 4]);
+				}
+				return 1;
+		}
+		if(r == REG_HLP) {
+			return 0;
+		}
+		switch(op & 7) {
+			case 4: case 5: /* INC r / DEC r */
+				x_pc_add(e, 1);
+				x_incdec(e, op & 1, r);
+				return 1;
+			case 6: /* LD r,n */
+				x_pc_add(e, len);
+				e8(e, 0xB8); e32(e, (uint8_t)o->imm); /* mov eax, imm */
+				x_set8(e, r, 0);
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static void x_op(struct emit *e, const struct block_op *o, int last) {
+	if(!x_inline(e, o)) {
+		x_pc_add(e, o->skip);
+		if(o->op != 0xCB && instr_length[o->op] > 1) {
+			e8(e, 0x66); e8(e, 0xC7); mrm(e, 0, G(imm)); /* mov word [imm], imm16 */
+			e8(e, o->imm & 0xFF); e8(e, o->imm >> 8);
+		}
+		x_spill(e);
+		x_arg_gb(e);
+		x_call(e, (host_f)o->fn);
+		x_reload(e);
+	}
+	if(o->cycles) {
+		e8(e, 0x48); e8(e, 0x83); mrm(e, 0, G(cycle_counter)); e8(e, o->cycles << 2);
+	}
+	e8(e, 0x48); e8(e, 0xFF); mrm(e, 0, G(instr_counter)); /* inc qword */
+	if(!last) {
+		e8(e, 0x48); e8(e, 0x8B); mrm(e, 0, G(cycle_counter)); /* mov rax, [cycle_counter] */
+		e8(e, 0x48); e8(e, 0x3B); mrm(e, 0, G(until)); /* cmp rax, [until] */
+		e8(e, 0x0F); e8(e, 0x83); /* jae exit */
+		e->exits[e->nexits++] = e->p;
+		e32(e, 0);
+	}
+}
+
+/* Drops every block compiled into the buffer, they count their runs again
+ * from 0 and get compiled again once hot. Translations from aot.c stay. */
+static void jit_reset(struct gb *gb) {
+	struct jit *j = gb->jit;
+	for(unsigned i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+		struct block *b = &gb->blocks->blocks[i];
+		uintptr_t code = (uintptr_t)b->code;
+		if(code >= (uintptr_t)j->mem && code < (uintptr_t)(j->mem + JIT_SIZE)) {
+			b->code = NULL;
+			b->hits = 0;
+		}
+	}
+	j->used = 0;
+	++j->resets;
+}
+
+void jit_compile(struct gb *gb, struct block *b) {
+	struct jit *j = gb->jit;
+	struct emit e;
+	union {
+		uint8_t *p;
+		void (*f)(struct gb *);
+	} code;
+	
+	if(j->used + JIT_BLOCK_MAX > j->size) {
+		jit_reset(gb);
+	}
+	code.p = e.p = j->mem + j->used;
+	e.nexits = 0;
+	x_prologue(&e);
+	for(unsigned i = 0; i < b->count; ++i) {
+		x_op(&e, &b->ops[i], i + 1 == b->count);
+	}
+	for(unsigned i = 0; i < e.nexits; ++i) {
+		int32_t rel = (int32_t)(e.p - e.exits[i] - 4);
+		memcpy(e.exits[i], &rel, 4);
+	}
+	x_epilogue(&e);
+	j->used = (e.p - j->mem + 15) & ~(size_t)15;
+	b->code = code.f;
+}
+
+/* Turns the recompiler on for gb, -1 where it is not available. */
+int jit_enable(struct gb *gb) {
+	struct jit *j;
+	if(gb->jit) {
+		return 0;
+	}
+	j = calloc(1, sizeof(struct jit));
+#ifdef _WIN32
+	j->mem = VirtualAlloc(NULL, JIT_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	j->mem = mmap(NULL, JIT_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(j->mem == MAP_FAILED) {
+		j->mem = NULL;
+	}
+#endif
+	if(j->mem == NULL) {
+		free(j);
+		return -1;
+	}
+	j->size = JIT_SIZE;
+	gb->jit = j;
+	return 0;
+}
+
+void jit_free(struct gb *gb) {
+	if(gb->jit == NULL) {
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(gb->jit->mem, 0, MEM_RELEASE);
+#else
+	munmap(gb->jit->mem, JIT_SIZE);
+#endif
+	free(gb->jit);
+	gb->jit = NULL;
+}
+
+#else /* JIT_X64 */
+
+void jit_compile(struct gb *gb, struct block *b) {
+}
+
+int jit_enable(struct gb *gb) {
+	return -1;
+}
+
+void jit_free(struct gb *gb) {
+}
+
+#endif /* JIT_X64 */
+
+static int lockstep_same(struct gb *a, struct gb *b, int ram) {
+	if(memcmp(&a->r, &b->r, sizeof(struct registers))
+		|| a->cycle_counter != b->cycle_counter
+		|| a->instr_counter != b->instr_counter) {
+		return 0;
+	}
+	if(!ram) {
+		return 1;
+	}
+	if(memcmp(a->wram, b->wram, 0x2000)
+		|| memcmp(a->hram, b->hram, 127)
+		|| memcmp(a->vram, b->vram, 0x2000)
+		|| memcmp(a->oam, b->oam, 160)) {
+		return 0;
+	}
+	for(unsigned address = 0xFF00; address <= 0xFFFF; address = address == 0xFF7F ? 0xFFFF : address + 1) {
+		if(read(a, address) != read(b, address)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void lockstep_dump(FILE *out, const char *name, struct gb *gb) {
+	fprintf(out, "%s: PC=%04X SP=%04X AF=%04X BC=%04X DE=%04X HL=%04X cycles=%llu instrs=%llu\n",
+		name, gb->r.PC, gb->r.SP, gb->r.AF, gb->r.BC, gb->r.DE, gb->r.HL,
+		(unsigned long long)gb->cycle_counter, (unsigned long long)gb->instr_counter);
+}
+
+/*
+ * Runs rom for budget cycles on the interpreter and on the recompiler side by
+ * side, LOCKSTEP_CYCLES at a time. Registers and counters are compared after
+ * every run, and memory and the IO registers every LOCKSTEP_RAM runs. Returns
+ * 0 if they never differ.
+ *
+ * The interpreter runs every op on its own, so the fused groups the
+ * recompiler side still interprets its cold blocks with are checked too,
+ * down to the cycle each of their ops touches IO on.
+ *
+ * Shorter runs would check more often, but a run that stops inside a block
+ * makes the next one start a block of its own at that PC. Stop too often and
+ * those evict the real blocks before they get hot, so nothing is compiled.
+ *
+ * With refill the recompiler only gets JIT_REFILL_SIZE of its buffer, which
+ * then fills up and starts over again and again. For it to pass the buffer
+ * has to fill up, and no hot block may be left without code afterwards.
+ */
+int jit_lockstep(const char *rom, uint64_t budget, int refill, FILE *out) {
+	struct gb *ref = gb_alloc();
+	struct gb *gb = gb_alloc();
+	int ret = 0;
+	
+	if(cart_load(ref, rom) || cart_load(gb, rom)) {
+		fprintf(out, "%s: could not load rom\n", rom);
+		ret = -1;
+	} else if(jit_enable(gb)) {
+		fprintf(out, "lockstep: no recompiler in this build\n");
+		ret = -1;
+	} else {
+		ref->blocks->unfused = 1;
+		if(refill) {
+			gb->jit->size = JIT_REFILL_SIZE;
+		}
+		cpu_bios_init(ref);
+		cpu_bios_init(gb);
+		for(unsigned n = 0; gb->cycle_counter < budget && !gb->stop_reason; ++n) {
+			uint64_t from = gb->instr_counter;
+			run_cycles(ref, LOCKSTEP_CYCLES);
+			run_cycles(gb, LOCKSTEP_CYCLES);
+			if(!lockstep_same(ref, gb, n % LOCKSTEP_RAM == 0)) {
+				fprintf(out, "lockstep: mismatch between instructions %llu and %llu\n",
+					(unsigned long long)from, (unsigned long long)gb->instr_counter);
+				lockstep_dump(out, "interpreter", ref);
+				lockstep_dump(out, "jit", gb);
+				ret = 1;
+				break;
+			}
+		}
+		if(!ret) {
+			fprintf(out, "lockstep: %llu instructions, %llu cycles, no mismatch\n",
+				(unsigned long long)gb->instr_counter, (unsigned long long)gb->cycle_counter);
+		}
+		if(!ret && refill) {
+			unsigned cold = 0;
+			for(unsigned i = 0; i < BLOCK_CACHE_SIZE; ++i) {
+				const struct block *b = &gb->blocks->blocks[i];
+				cold += b->count && b->region <= 2 && b->hits >= JIT_HOT && !b->code;
+			}
+			fprintf(out, "lockstep: the buffer filled up %u times, %u hot blocks left uncompiled\n",
+				gb->jit->resets, cold);
+			ret = !gb->jit->resets || cold;
+		}
+	}
+	gb_free(ref);
+	gb_free(gb);
+	return ret;
+}
@@ -18,215 +18,207 @@
 
 /* ************************************************************** */
 /* cart.c */
-uint8_t ext0_read(uint16_t); /* 0000-3FFF */
-uint8_t ext1_read(uint16_t); /* 4000-7FFF */
-uint8_t ext2_read(uint16_t); /* A000-BFFF */
+uint8_t ext0_read(struct gb *, uint16_t); /* 0000-3FFF */
+uint8_t ext1_read(struct gb *, uint16_t); /* 4000-7FFF */
+uint8_t ext2_read(struct gb *, uint16_t); /* A000-BFFF */
 
-void ext0_write(uint16_t, uint8_t); /* 0000-3FFF */
-void ext1_write(uint16_t, uint8_t); /* 4000-7FFF */
-void ext2_write(uint16_t, uint8_t); /* A000-BFFF */
+void ext0_write(struct gb *, uint16_t, uint8_t); /* 0000-3FFF */
+void ext1_write(struct gb *, uint16_t, uint8_t); /* 4000-7FFF */
+void ext2_write(struct gb *, uint16_t, uint8_t); /* A000-BFFF */
 
 /* io.c */
-uint8_t io_read(uint16_t); /* FF00-FF7F */
-void io_write(uint16_t, uint8_t); /* FF80-FFFE */
+uint8_t io_read(struct gb *, uint16_t); /* FF00-FF7F */
+void io_write(struct gb *, uint16_t, uint8_t); /* FF80-FFFE */
 
 /* video.c */
-uint8_t vram_read(uint16_t); /* 8000-9FFF */
-void vram_write(uint16_t, uint8_t); /* 8000-9FFF */
-
-/* I use function pointers here to make things easier, faster and simpler. Built in bound checking is nice as well. */
+uint8_t vram_read(struct gb *, uint16_t); /* 8000-9FFF */
+void vram_write(struct gb *, uint16_t, uint8_t); /* 8000-9FFF */
+
+/*
+ * The memory map is split into 256 byte pages. A page either points straight
+ * at the backing memory (the pointer is to the first byte of the page), or is
+ * NULL, in which case the access goes to the handler for that page instead.
+ * That way a plain load or store is a single table load and a memory access.
+ */
 
 /* ************************************************************** */
+/* READ */
+uint8_t oam_read(struct gb *, uint16_t); /* FE00-FE9F */
+uint8_t cpu_read(struct gb *, uint16_t); /* FF00-FFFF */
+uint8_t hram_read(struct gb *, uint16_t); /* FF80-FFFE */
+uint8_t wram_read(struct gb *, uint16_t); /* C000-FDFF */
 
-static uint8_t *wram;
-static uint8_t *hram;
-uint8_t *oam;
-uint8_t *vram;
+/* WRITE */
+void oam_write(struct gb *, uint16_t, uint8_t); /* FE00-FE9F */
+void cpu_write(struct gb *, uint16_t, uint8_t); /* FF00-FFFF */
+void hram_write(struct gb *, uint16_t, uint8_t); /* FF80-FFFE */
+void wram_write(struct gb *, uint16_t, uint8_t); /* C000-FDFF */
+
+static void map_handlers(struct gb *gb, unsigned page, unsigned count, read_f rf, write_f wf) {
+	for(unsigned i = page; i < page + count; ++i) {
+		gb->readhandler[i] = rf;
+		gb->writehandler[i] = wf;
+	}
+}
 
-void mem_alloc() {
-	/* 8 kB Working Ram */
-	wram = malloc(0x2000);
-	hram = malloc(127);
-	oam = malloc(160);
-	vram = malloc(0x2000);
+void mem_map_read(struct gb *gb, unsigned page, unsigned count, uint8_t *base) {
+	for(unsigned i = 0; i < count; ++i) {
+		gb->readpage[page + i] = base ? base + (i << 8) : NULL;
+	}
 }
 
-void mem_free() {
-	free(vram);
-	free(oam);
-	free(hram);
-	free(wram);
+void mem_map_write(struct gb *gb, unsigned page, unsigned count, uint8_t *base) {
+	for(unsigned i = 0; i < count; ++i) {
+		gb->writepage[page + i] = base ? base + (i << 8) : NULL;
+	}
 }
 
-/* ************************************************************** */
-/* READ */
-uint8_t wram_read(uint16_t); /* C000-DFFF */
-uint8_t wrame_read(uint16_t); /* E000-FDFF */
-uint8_t oam_read(uint16_t); /* FE00-FE9F */
-uint8_t fxxx_read(uint16_t); /* F000-FFFF */
-uint8_t cpu_read(uint16_t); /* FF00-FFFF */
-uint8_t hram_read(uint16_t); /* FF80-FFFE */
-
-
-/* memory map */
-static const read_f readmap[16] = {
-	/* 0000-3fff  external cart 0 */
-	ext0_read, ext0_read, ext0_read, ext0_read,
-	/* 4000-7fff  external cart 0 */
-	ext1_read, ext1_read, ext1_read, ext1_read,
-	/* 8000-9fff  8kB Video Ram */
-	vram_read, vram_read,
+static void mem_map_reset(struct gb *gb) {
+	/* 0000-7fff  external cart, the cart maps its own rom banks */
+	map_handlers(gb, 0x00, 0x40, ext0_read, ext0_write);
+	map_handlers(gb, 0x40, 0x40, ext1_read, ext1_write);
+	/* 8000-9fff  8kB Video Ram, stores go through vram_write so the PPU
+	 * catches up first and the decoded tiles stay up to date */
+	map_handlers(gb, 0x80, 0x20, vram_read, vram_write);
+	mem_map_read(gb, 0x80, 0x20, gb->vram);
 	/* a000-bfff  external cart stuff */
-	ext2_read, ext2_read,
-	/* c000-dfff  8kB Work Ram */
-	wram_read, wram_read,
+	map_handlers(gb, 0xA0, 0x20, ext2_read, ext2_write);
+	/* c000-dfff  8kB Work Ram, the handlers are used once a page holds
+	 * cached code, see block.c */
+	map_handlers(gb, 0xC0, 0x3E, wram_read, wram_write);
+	mem_map_read(gb, 0xC0, 0x20, gb->wram);
+	mem_map_write(gb, 0xC0, 0x20, gb->wram);
 	/* e000-fdff  Work Ram Echo (usually unused) */
-	wrame_read, /* e000 */
-	/* fe00-ffff  CPU stuff */
-	fxxx_read /* f000 */
-};
-
-/* fxxx range */
-static const read_f fxxx_readmap[16] = {
-	/* 000h-dffh  Work Ram Echo */
-	wrame_read, wrame_read, wrame_read, wrame_read,
-	wrame_read, wrame_read, wrame_read, wrame_read,
-	wrame_read, wrame_read, wrame_read, wrame_read,
-	wrame_read, wrame_read,
-	/* e00-e9f  OAM (160 bytes) */
-	/* ea0-eff  NIL */
-	oam_read,
-	/* f00-fff  CPU */
-	cpu_read
-};
-
-uint8_t wram_read(uint16_t address) {
-	return wram[address - 0xC000];
-}
-
-uint8_t wrame_read(uint16_t address) {
-	return wram_read(address - 0x2000);
-}
-
-uint8_t oam_read(uint16_t address) {
+	mem_map_read(gb, 0xE0, 0x1E, gb->wram);
+	mem_map_write(gb, 0xE0, 0x1E, gb->wram);
+	/* fe00-fe9f  OAM (160 bytes), fea0-feff  NIL */
+	map_handlers(gb, 0xFE, 1, oam_read, oam_write);
+	/* ff00-ffff  CPU stuff */
+	map_handlers(gb, 0xFF, 1, cpu_read, cpu_write);
+}
+
+void mem_alloc(struct gb *gb) {
+	/* 8 kB Working Ram */
+	gb->wram = calloc(1, 0x2000);
+	gb->hram = calloc(1, 127);
+	gb->oam = calloc(1, 160);
+	gb->vram = calloc(1, 0x2000);
+	mem_map_reset(gb);
+}
+
+void mem_free(struct gb *gb) {
+	mem_map_read(gb, 0x80, 0x80, NULL);
+	mem_map_write(gb, 0x80, 0x80, NULL);
+	free(gb->vram);
+	free(gb->oam);
+	free(gb->hram);
+	free(gb->wram);
+}
+
+struct gb *gb_alloc() {
+	struct gb *gb = calloc(1, sizeof(struct gb));
+	alu_init();
+	video_init();
+	sched_reset(gb);
+	gb->ppu_next = UINT64_MAX; /* LCD off */
+	cart_mem_reset(gb);
+	mem_alloc(gb);
+	block_alloc(gb);
+	return gb;
+}
+
+void gb_free(struct gb *gb) {
+	cart_free(gb);
+	mem_free(gb);
+	block_free(gb);
+	jit_free(gb);
+	free(gb);
+}
+
+/* ************************************************************** */
+/* READ */
+uint8_t oam_read(struct gb *gb, uint16_t address) {
+	if(gb->dma_active) {
+		return 0xFF;
+	}
 	if(address < 0xfea0) {
-		return oam[address - 0xfe00];
+		return gb->oam[address - 0xfe00];
 	}
 	return 0;
 }
 
-uint8_t fxxx_read(uint16_t address) {
-	return fxxx_readmap[(address >> 8) & 0xF](address);
-}
-
-uint8_t cpu_read(uint16_t address) {
+uint8_t cpu_read(struct gb *gb, uint16_t address) {
 	if(address == 0xFFFF) {
-		return io_read(address);
+		return io_read(gb, address);
 	}
 	if((address >> 7) & 1) {
-		return hram_read(address);
+		return hram_read(gb, address);
 	}
-	return io_read(address);
+	return io_read(gb, address);
+}
+
+uint8_t hram_read(struct gb *gb, uint16_t address) {
+	return gb->hram[(uint8_t)address - 0x80];
 }
 
-uint8_t hram_read(uint16_t address) {
-	return hram[(uint8_t)address - 0x80];
+uint8_t wram_read(struct gb *gb, uint16_t address) {
+	return gb->wram[address & 0x1FFF];
 }
 
-uint8_t read(uint16_t address) {
-	/* Use address blocks to avoid if branching. :D */
-	/* With just 16 blocks we can massively reduce the branching here. */
-	return readmap[address >> 12](address);
+uint8_t read(struct gb *gb, uint16_t address) {
+	register uint8_t *page = gb->readpage[address >> 8];
+	if(page) {
+		return page[address & 0xFF];
+	}
+	return gb->readhandler[address >> 8](gb, address);
 }
 
-uint16_t read16(uint16_t address) {
-	return (read(address)) | (read(address + 1) << 8);
+uint16_t read16(struct gb *gb, uint16_t address) {
+	return (read(gb, address)) | (read(gb, address + 1) << 8);
 }
 
 
 /* ************************************************************** */
 /* WRITE */
-void wram_write(uint16_t, uint8_t); /* C000-DFFF */
-void wrame_write(uint16_t, uint8_t); /* E000-FDFF */
-void oam_write(uint16_t, uint8_t); /* FE00-FE9F */
-void fxxx_write(uint16_t, uint8_t); /* F000-FFFF */
-void cpu_write(uint16_t, uint8_t); /* FF00-FFFF */
-void hram_write(uint16_t, uint8_t); /* FF00-FF7F */
-void vram_write(uint16_t, uint8_t); /* 8000-9FFF */
-
-/* memory map */
-static const write_f writemap[16] = {
-	/* 0000-7fff  external cart stuff */
-	ext0_write, ext0_write, ext0_write, ext0_write,
-	ext1_write, ext1_write, ext1_write, ext1_write,
-	/* 8000-9fff  8kB Video Ram */
-	vram_write, vram_write,
-	/* a000-bfff  external cart stuff */
-	ext2_write, ext2_write,
-	/* c000-dfff  8kB Work Ram */
-	wram_write, wram_write,
-	/* e000-fdff  Work Ram Echo (usually unused) */
-	wrame_write, /* e000 */
-	/* fe00-ffff  CPU stuff */
-	fxxx_write /* f000 */
-};
-
-/* fxxx range */
-static const write_f fxxx_writemap[16] = {
-	/* 000-dff  Work Ram Echo */
-	wrame_write, wrame_write, wrame_write, wrame_write,
-	wrame_write, wrame_write, wrame_write, wrame_write,
-	wrame_write, wrame_write, wrame_write, wrame_write,
-	wrame_write, wrame_write,
-	/* e00-e9f  OAM (160 bytes) */
-	/* ea0-eff  NIL */
-	oam_write,
-	/* f00-fff  CPU */
-	cpu_write
-};
-
-void wram_write(uint16_t address, uint8_t value) {
-	wram[address - 0xC000] = value;
-}
-
-void wrame_write(uint16_t address, uint8_t value) {
-	wram_write(address - 0x2000, value);
-}
-
-void oam_write(uint16_t address, uint8_t value) {
+void oam_write(struct gb *gb, uint16_t address, uint8_t value) {
 	if(address < 0xfea0) {
-		oam[address - 0xfe00] = value;
+		video_sync(gb);
+		gb->oam[address - 0xfe00] = value;
 	}
 }
 
-void fxxx_write(uint16_t address, uint8_t value) {
-	fxxx_writemap[(address >> 8) & 0xF](address, value);
-}
-
-void cpu_write(uint16_t address, uint8_t value) {
+void cpu_write(struct gb *gb, uint16_t address, uint8_t value) {
 	if(address == 0xFFFF) {
-		io_write(address, value);
+		io_write(gb, address, value);
 		return;
 	}
 	if((address >> 7) & 1) {
-		hram_write(address, value);
+		hram_write(gb, address, value);
 		return;
 	}
-	io_write(address, value);
+	io_write(gb, address, value);
 }
 
-void hram_write(uint16_t address, uint8_t value) {
-	hram[(uint8_t)address - 0x80] = value;
+void hram_write(struct gb *gb, uint16_t address, uint8_t value) {
+	gb->hram[(uint8_t)address - 0x80] = value;
+	block_invalidate(gb, address);
 }
 
-void write(uint16_t address, uint8_t value) {
-	/* Use address blocks to avoid if branching. :D */
-	/* With just 16 blocks we can massively reduce the branching here. */
-	writemap[address >> 12](address, value);
+void wram_write(struct gb *gb, uint16_t address, uint8_t value) {
+	gb->wram[address & 0x1FFF] = value;
+	block_invalidate(gb, address);
 }
 
-void write16(uint16_t address, uint16_t value) {
-	write(address, value);
-	write(address + 1, value >> 8);
+void write(struct gb *gb, uint16_t address, uint8_t value) {
+	register uint8_t *page = gb->writepage[address >> 8];
+	if(page) {
+		page[address & 0xFF] = value;
+		return;
+	}
+	gb->writehandler[address >> 8](gb, address, value);
 }
 
+void write16(struct gb *gb, uint16_t address, uint16_t value) {
+	write(gb, address, value);
+	write(gb, address + 1, value >> 8);
+}
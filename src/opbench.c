@@ -0,0 +1,107 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Per opcode microbenchmark. Calls the real handlers from instr_map and the CB
+ * tables over and over against a few synthetic register states and prints the
+ * host time per call, slowest first. The cost of the loop itself is measured
+ * with NOP and taken off.
+ *
+ * The code being "executed" sits in work ram at C000. The operand is C180 so
+ * immediates, (nn), (HL), (BC) and (DE) all land in work ram and the LDH and
+ * (C) forms land in high ram.
+ */
+
+#include "failboy.h"
+#include "cpu_instr.h"
+#include <stdlib.h>
+
+#define OPBENCH_ITERS	(1 << 20)
+
+struct opresult {
+	uint16_t op; /* 0x100 and up are the CB ops */
+	double ns;
+};
+
+/* Alternates the flags so conditional ops see both the taken and not taken
+ * path. */
+static void opbench_states(struct registers *states) {
+	static const uint8_t flags[4] = { 0x00, 0x80, 0x10, 0x90 };
+	for(unsigned i = 0; i < 4; ++i) {
+		states[i].A = 0x3C + i * 0x11;
+		states[i].F = flags[i];
+		states[i].BC = 0xC120;
+		states[i].DE = 0xC140;
+		states[i].HL = 0xC100;
+		states[i].SP = 0xDFF0;
+		states[i].PC = 0xC001;
+	}
+}
+
+static double opbench_time(struct gb *gb, const struct registers *states, uint16_t op) {
+	const instruction_f fn = op < 0x100 ? instr_map[op] : instr_cb_map[op & 0xFF];
+	uint64_t start = clock_ns();
+	for(unsigned i = 0; i < OPBENCH_ITERS; ++i) {
+		gb->r = states[i & 3];
+		fn(gb);
+	}
+	return (clock_ns() - start) / (double)OPBENCH_ITERS;
+}
+
+static int opresult_cmp(const void *a, const void *b) {
+	const struct opresult *x = a;
+	const struct opresult *y = b;
+	return (x->ns < y->ns) - (x->ns > y->ns);
+}
+
+int opbench_run(FILE *out) {
+	struct gb *gb = gb_alloc();
+	struct registers states[4];
+	struct opresult results[512];
+	double base;
+	
+	opbench_states(states);
+	gb->imm = 0xC180;
+	
+	/* warm up, then the loop overhead */
+	opbench_time(gb, states, 0x00);
+	base = opbench_time(gb, states, 0x00);
+	
+	for(uint16_t op = 0; op < 512; ++op) {
+		if(op >= 0x100) {
+			/* the CB handlers expect the prefix and op to be fetched */
+			opbench_states(states);
+			for(unsigned i = 0; i < 4; ++i) {
+				states[i].PC = 0xC002;
+			}
+		}
+		results[op].op = op;
+		results[op].ns = opbench_time(gb, states, op) - base;
+	}
+	gb_free(gb);
+	
+	qsort(results, 512, sizeof(struct opresult), opresult_cmp);
+	fprintf(out, "%4s  %-5s  %-14s %8s\n", "rank", "op", "handler", "ns/op");
+	for(unsigned i = 0; i < 512; ++i) {
+		uint16_t op = results[i].op;
+		if(op < 0x100) {
+			fprintf(out, "%4u  %02X     %-14s %8.2f\n", i + 1, op, instr_names[op], results[i].ns);
+		} else {
+			fprintf(out, "%4u  CB %02X  %-14s %8.2f\n", i + 1, op & 0xFF, instr_cb_names[op & 0xFF], results[i].ns);
+		}
+	}
+	fprintf(out, "loop overhead %.2f ns, %u calls per op\n", base, OPBENCH_ITERS);
+	return 0;
+}
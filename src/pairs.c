@@ -0,0 +1,155 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Opcode pair and triple profiler, for picking the fused handlers in
+ * cpu_instr_fuse.h. Runs a rom one step() at a time, counts every sequence of
+ * two and three opcodes that ran back to back and prints the most common ones
+ * that block.c is able to fuse, ready to paste into FUSED_OPCODES. A sequence
+ * never spans an interrupt or a HALT, those can not be fused.
+ */
+
+#include "block.h"
+#include <stdlib.h>
+
+#define PAIRS_TOP	24
+#define TRIPLES_BITS	16
+#define TRIPLES_SIZE	(1 << TRIPLES_BITS)
+
+struct seq {
+	uint32_t ops; /* first op in the highest byte used */
+	uint64_t count;
+};
+
+struct pairs {
+	uint64_t pair[256][256];
+	/* open addressing, key + 1 so 0 is empty, new keys are dropped once full */
+	uint32_t triple_key[TRIPLES_SIZE];
+	uint64_t triple[TRIPLES_SIZE];
+	unsigned ntriples;
+	uint64_t instrs;
+};
+
+static void pairs_triple(struct pairs *p, uint32_t key) {
+	unsigned i = (key * 2654435761u) >> (32 - TRIPLES_BITS);
+	while(p->triple_key[i] && p->triple_key[i] != key + 1) {
+		i = (i + 1) & (TRIPLES_SIZE - 1);
+	}
+	if(!p->triple_key[i]) {
+		if(p->ntriples == TRIPLES_SIZE / 2) {
+			return;
+		}
+		p->triple_key[i] = key + 1;
+		++p->ntriples;
+	}
+	++p->triple[i];
+}
+
+static int seq_cmp(const void *a, const void *b) {
+	const struct seq *x = a;
+	const struct seq *y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+/* Fusable if every op but the last can lead, see block_can_fuse(). */
+static int pairs_fusable(uint32_t ops, unsigned n) {
+	for(unsigned i = 0; i < n; ++i) {
+		if(!block_can_fuse(ops >> (8 * (n - 1 - i)) & 0xFF, i + 1 == n)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void pairs_print(FILE *out, const struct pairs *p, struct seq *s, unsigned count, unsigned n) {
+	unsigned shown = 0;
+	qsort(s, count, sizeof(struct seq), seq_cmp);
+	fprintf(out, "%s\n", n == 2 ? "pairs" : "triples");
+	for(unsigned i = 0; i < count && shown < PAIRS_TOP && s[i].count; ++i) {
+		if(!pairs_fusable(s[i].ops, n)) {
+			continue;
+		}
+		fprintf(out, "\t/* %5.2f%% */ X%u(", 100.0 * s[i].count / p->instrs, n);
+		for(unsigned j = 0; j < n; ++j) {
+			uint8_t op = s[i].ops >> (8 * (n - 1 - j));
+			fprintf(out, "%s0x%02X, %s", j ? ", " : "", op, instr_names[op]);
+		}
+		fputs(") \\\n", out);
+		++shown;
+	}
+}
+
+/* Profiles budget cycles of rom. Returns 0 on success. */
+int pairs_run(const char *rom, uint64_t budget, FILE *out) {
+	struct gb *gb = gb_alloc();
+	struct pairs *p;
+	struct seq *s;
+	uint32_t last = 0;
+	unsigned chain = 0; /* opcodes in last that ran back to back */
+
+	if(cart_load(gb, rom)) {
+		fprintf(stderr, "%s: could not load rom\n", rom);
+		gb_free(gb);
+		return -1;
+	}
+	cpu_bios_init(gb);
+	p = calloc(1, sizeof(struct pairs));
+	gb->until = budget;
+	while(gb->cycle_counter < budget && !gb->stop_reason) {
+		uint8_t op;
+		uint8_t halted = gb->halted;
+		uint64_t instrs = gb->instr_counter;
+		sched_run(gb);
+		op = read(gb, gb->r.PC);
+		step(gb);
+		if(gb->instr_counter == instrs) {
+			/* an interrupt was dispatched or HALT went on waiting, op did
+			 * not run */
+			chain = 0;
+			continue;
+		}
+		if(halted) {
+			/* op is the first after HALT */
+			chain = 0;
+		}
+		last = last << 8 | op;
+		if(chain >= 1) {
+			++p->pair[last >> 8 & 0xFF][op];
+		}
+		if(chain >= 2) {
+			pairs_triple(p, last & 0xFFFFFF);
+		}
+		++chain;
+		++p->instrs;
+	}
+	gb_free(gb);
+
+	fprintf(out, "%s: %llu instructions\n", rom, (unsigned long long)p->instrs);
+	s = calloc(TRIPLES_SIZE > 0x10000 ? TRIPLES_SIZE : 0x10000, sizeof(struct seq));
+	for(unsigned i = 0; i < 0x10000; ++i) {
+		s[i].ops = i;
+		s[i].count = p->pair[i >> 8][i & 0xFF];
+	}
+	pairs_print(out, p, s, 0x10000, 2);
+	for(unsigned i = 0; i < TRIPLES_SIZE; ++i) {
+		s[i].ops = p->triple_key[i] - 1;
+		s[i].count = p->triple_key[i] ? p->triple[i] : 0;
+	}
+	pairs_print(out, p, s, TRIPLES_SIZE, 3);
+
+	free(s);
+	free(p);
+	return 0;
+}
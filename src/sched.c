@@ -0,0 +1,137 @@
+/**
+ * This file is part of Failboy, a Gameboy Emulator
+ * Copyright (c) Robert Maupin <chasesan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Event scheduler. Every piece of hardware that does something at a point in
+ * time (a PPU mode change, a timer overflow, the end of a serial transfer or
+ * DMA) puts its next deadline here instead of being ticked by the CPU. The
+ * deadlines sit in a min-heap keyed by cycle, one slot per event, so the CPU
+ * only runs up to the earliest one, see cpu_exec(), and then sched_run()
+ * fires whatever is due.
+ *
+ * An event fires after the instruction that reaches its deadline and gets the
+ * deadline it was scheduled for, so periodic events can schedule the next
+ * one from that without drifting.
+ */
+
+#include "failboy.h"
+
+typedef void (*event_f)(struct gb *, uint64_t);
+
+/* io.c */
+void timer_event(struct gb *, uint64_t);
+void serial_event(struct gb *, uint64_t);
+void dma_event(struct gb *, uint64_t);
+
+/* video.c */
+void ppu_event(struct gb *, uint64_t);
+
+static const event_f events[EVENTS] = {
+	ppu_event,
+	timer_event,
+	serial_event,
+	dma_event
+};
+
+/* Earlier deadline first, ties go by event number. */
+static int sched_before(const struct event *a, const struct event *b) {
+	return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static void sched_swap(struct sched *s, unsigned i, unsigned j) {
+	struct event t = s->heap[i];
+	s->heap[i] = s->heap[j];
+	s->heap[j] = t;
+	s->pos[s->heap[i].id] = i;
+	s->pos[s->heap[j].id] = j;
+}
+
+static void sched_up(struct sched *s, unsigned i) {
+	while(i && sched_before(&s->heap[i], &s->heap[(i - 1) / 2])) {
+		sched_swap(s, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sched_down(struct sched *s, unsigned i) {
+	for(;;) {
+		unsigned min = i, l = i * 2 + 1, r = i * 2 + 2;
+		if(l < s->count && sched_before(&s->heap[l], &s->heap[min])) {
+			min = l;
+		}
+		if(r < s->count && sched_before(&s->heap[r], &s->heap[min])) {
+			min = r;
+		}
+		if(min == i) {
+			return;
+		}
+		sched_swap(s, i, min);
+		i = min;
+	}
+}
+
+void sched_reset(struct gb *gb) {
+	gb->sched.count = 0;
+	for(unsigned i = 0; i < EVENTS; ++i) {
+		gb->sched.pos[i] = SCHED_NONE;
+	}
+}
+
+/* Sets the deadline of event id, replacing the one it had. If that is before
+ * the end of the current run the run stops there instead. */
+void sched_add(struct gb *gb, unsigned id, uint64_t when) {
+	struct sched *s = &gb->sched;
+	unsigned i = s->pos[id];
+	if(i == SCHED_NONE) {
+		i = s->count++;
+		s->heap[i].id = id;
+		s->pos[id] = i;
+	}
+	s->heap[i].when = when;
+	sched_up(s, i);
+	sched_down(s, s->pos[id]);
+	if(when < gb->until) {
+		gb->until = when;
+	}
+}
+
+void sched_cancel(struct gb *gb, unsigned id) {
+	struct sched *s = &gb->sched;
+	unsigned i = s->pos[id];
+	if(i == SCHED_NONE) {
+		return;
+	}
+	sched_swap(s, i, --s->count);
+	s->pos[id] = SCHED_NONE;
+	if(i < s->count) {
+		sched_up(s, i);
+		sched_down(s, s->pos[s->heap[i].id]);
+	}
+}
+
+/* The earliest deadline, UINT64_MAX if nothing is scheduled. */
+uint64_t sched_next(struct gb *gb) {
+	return gb->sched.count ? gb->sched.heap[0].when : UINT64_MAX;
+}
+
+/* Fires every event that is due, in deadline order. */
+void sched_run(struct gb *gb) {
+	struct sched *s = &gb->sched;
+	while(s->count && s->heap[0].when <= gb->cycle_counter) {
+		struct event e = s->heap[0];
+		sched_cancel(gb, e.id);
+		events[e.id](gb, e.when);
+	}
+}
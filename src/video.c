@@ -13,12 +13,541 @@
  * GNU General Public License for more details.
  */
 
+/*
+ * The PPU timing. Every line is OAM search, drawing and hblank, 456 cycles
+ * in all, then ten lines of vblank. LY, the STAT mode and the vblank and STAT
+ * interrupts all follow from the mode changes.
+ *
+ * Nothing ticks it and it has no event per mode change either. It catches up,
+ * one mode change at a time, only when the CPU touches it: its registers, IF,
+ * stores to VRAM and OAM, DMA. Since everything that changes what it draws
+ * makes it catch up first, every line is still drawn with the registers as
+ * they were when its drawing ended. The one deadline it keeps is for the
+ * interrupts, the next vblank, or the next mode change while a STAT
+ * interrupt is enabled in both STAT and IE.
+ *
+ * The picture is drawn a whole line at a time when drawing ends, with the
+ * registers as they are then. The tiles are kept decoded in tile_rows, a
+ * store to tile data decodes that one row again, the two bitplanes each go
+ * through tile_bits and get ORed together into the 8 colour numbers at once.
+ * Drawing only copies rows. A line that would come out the same as the last
+ * time it was drawn is not drawn at all, see ppu_render().
+ *
+ * Render skip leaves out the drawing and nothing else, the timing, LY, STAT
+ * and the interrupts are the same whether a frame is drawn or not.
+ */
+
 #include "failboy.h"
+#include <pthread.h>
+#include <string.h>
+
+enum {
+	MODE_HBLANK = 0,
+	MODE_VBLANK = 1,
+	MODE_OAM = 2,
+	MODE_DRAW = 3
+};
+
+#define OAM_CYCLES	80
+#define DRAW_CYCLES	172
+#define HBLANK_CYCLES	(LINE_CYCLES - OAM_CYCLES - DRAW_CYCLES)
+#define SCREEN_LINES	144
+#define LAST_LINE	153
+
+#define LCDC_BG	0x01 /* background and window */
+#define LCDC_OBJ	0x02
+#define LCDC_OBJ_TALL	0x04 /* 8x16 sprites */
+#define LCDC_BG_MAP	0x08 /* 9C00 instead of 9800 */
+#define LCDC_TILES	0x10 /* 8000 unsigned instead of 9000 signed */
+#define LCDC_WINDOW	0x20
+#define LCDC_WINDOW_MAP	0x40
+#define LCDC_ON	0x80
+#define STAT_LYC	0x04 /* LY == LYC */
+#define STAT_WRITABLE	0x78 /* the interrupt enables */
+#define STAT_INTS	0x78
+
+#define OBJ_BEHIND	0x80 /* only over background colour 0 */
+#define OBJ_FLIP_Y	0x40
+#define OBJ_FLIP_X	0x20
+#define OBJ_PALETTE	0x10
+
+/*
+ * Every byte spread out over the low bits of 8 bytes, bit 7 (the leftmost
+ * pixel) in the first, so a tile row is tile_bits[lo] | tile_bits[hi] << 1.
+ */
+static uint64_t tile_bits[256];
+
+static pthread_once_t video_once = PTHREAD_ONCE_INIT;
+
+static void video_fill(void) {
+	for(unsigned n = 0; n < 256; ++n) {
+		uint8_t bits[8];
+		for(unsigned i = 0; i < 8; ++i) {
+			bits[i] = n >> (7 - i) & 1;
+		}
+		memcpy(&tile_bits[n], bits, 8);
+	}
+}
+
+void video_init() {
+	pthread_once(&video_once, video_fill);
+}
+
+/* Where to draw, or NULL to stop drawing. Lines are only drawn again when
+ * they change, so nothing else should write to it. */
+void video_framebuffer(struct gb *gb, uint8_t *framebuffer) {
+	gb->framebuffer = framebuffer;
+	for(unsigned i = 0; i < SCREEN_HEIGHT; ++i) {
+		gb->lines[i].drawn = 0;
+	}
+}
 
-uint8_t vram_read(uint16_t address) {
-	return vram[address - 0x8000];
+/* Turns render skip on or off. */
+void video_render_skip(struct gb *gb, int on) {
+	gb->render_skip = on;
 }
 
-void vram_write(uint16_t address, uint8_t value) {
-	vram[address - 0x8000] = value;
+/* With render skip on, draws the next frame the PPU starts. */
+void video_render_frame(struct gb *gb) {
+	gb->render_frame = 1;
+}
+
+/* STAT interrupt enable for modes 0-2 */
+static const uint8_t stat_mode_int[3] = { 0x08, 0x10, 0x20 };
+#define STAT_LYC_INT	0x40
+
+static void ppu_mode(struct gb *gb, uint8_t mode) {
+	gb->stat = (gb->stat & ~3) | mode;
+	if(mode < 3 && (gb->stat & stat_mode_int[mode])) {
+		cpu_request(gb, INT_STAT);
+	}
+}
+
+static void ppu_lyc(struct gb *gb) {
+	if(gb->ly == gb->lyc) {
+		gb->stat |= STAT_LYC;
+		if(gb->stat & STAT_LYC_INT) {
+			cpu_request(gb, INT_STAT);
+		}
+	} else {
+		gb->stat &= ~STAT_LYC;
+	}
+}
+
+static void ppu_line(struct gb *gb, uint8_t ly) {
+	gb->ly = ly;
+	if(ly == 0) {
+		gb->window_line = 0;
+		gb->lines_reused = 0;
+		gb->render_now = gb->render_frame;
+		gb->render_frame = 0;
+	}
+	ppu_lyc(gb);
+}
+
+/* The tile a tile map entry points at, 0-383. */
+static inline unsigned ppu_tile(struct gb *gb, uint8_t t) {
+	return gb->lcdc & LCDC_TILES ? t : 256 + (int8_t)t;
+}
+
+/* count tiles of row y of a tile map into out, from the tile at column x. */
+static void ppu_tiles(struct gb *gb, uint8_t *out, unsigned map, uint8_t x, uint8_t y, unsigned count) {
+	const uint8_t *tiles = gb->vram + map + (y >> 3) * 32;
+	unsigned row = y & 7;
+	for(unsigned i = 0; i < count; ++i) {
+		unsigned tile = ppu_tile(gb, tiles[(x / 8 + i) & 31]);
+		memcpy(out + i * 8, &gb->tile_rows[tile * 8 + row], 8);
+	}
+}
+
+/* Neither the map row nor the tile rows ppu_tiles() would copy changed after
+ * stamp. */
+static int ppu_tiles_clean(struct gb *gb, unsigned map, uint8_t x, uint8_t y, unsigned count, uint64_t stamp) {
+	const uint8_t *tiles = gb->vram + map + (y >> 3) * 32;
+	unsigned row = y & 7;
+	if(gb->map_stamp[(map - 0x1800) / 32 + (y >> 3)] > stamp) {
+		return 0;
+	}
+	for(unsigned i = 0; i < count; ++i) {
+		unsigned tile = ppu_tile(gb, tiles[(x / 8 + i) & 31]);
+		if(gb->tile_stamp[tile * 8 + row] > stamp) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Background and window colour numbers of the line, window is the key's. */
+static void ppu_background(struct gb *gb, uint8_t *line, uint8_t window) {
+	/* one tile either side for the fine scroll */
+	uint8_t tiles[SCREEN_WIDTH + 16];
+	int wx = gb->wx - 7;
+	if(!(gb->lcdc & LCDC_BG)) {
+		memset(line, 0, SCREEN_WIDTH);
+		return;
+	}
+	ppu_tiles(gb, tiles, gb->lcdc & LCDC_BG_MAP ? 0x1C00 : 0x1800,
+		gb->scx, gb->scy + gb->ly, SCREEN_WIDTH / 8 + 1);
+	memcpy(line, tiles + (gb->scx & 7), SCREEN_WIDTH);
+	if(window) {
+		ppu_tiles(gb, tiles, gb->lcdc & LCDC_WINDOW_MAP ? 0x1C00 : 0x1800,
+			0, window - 1, SCREEN_WIDTH / 8 + 1);
+		if(wx < 0) {
+			memcpy(line, tiles - wx, SCREEN_WIDTH);
+		} else {
+			memcpy(line + wx, tiles, SCREEN_WIDTH - wx);
+		}
+	}
+}
+
+/*
+ * The first ten sprites in OAM that are on the line into found, returns how
+ * many. Where they overlap the one with the lower X wins, then the one first
+ * in OAM, so they are sorted in that order.
+ */
+static unsigned ppu_oam_search(struct gb *gb, const uint8_t **found) {
+	unsigned height = gb->lcdc & LCDC_OBJ_TALL ? 16 : 8;
+	unsigned count = 0;
+	for(unsigned i = 0; i < 160 && count < OBJ_PER_LINE; i += 4) {
+		const uint8_t *s = gb->oam + i;
+		unsigned row = gb->ly + 16 - s[0];
+		if(row < height) {
+			unsigned j = count++;
+			for(; j && found[j - 1][1] > s[1]; --j) {
+				found[j] = found[j - 1];
+			}
+			found[j] = s;
+		}
+	}
+	return count;
+}
+
+/* The tile row sprite s shows on the line. */
+static unsigned ppu_sprite_row(struct gb *gb, const uint8_t *s) {
+	unsigned height = gb->lcdc & LCDC_OBJ_TALL ? 16 : 8;
+	unsigned row = gb->ly + 16 - s[0];
+	uint8_t tile = height == 16 ? s[2] & 0xFE : s[2];
+	if(s[3] & OBJ_FLIP_Y) {
+		row = height - 1 - row;
+	}
+	return tile * 8 + row;
+}
+
+/*
+ * The sprites found on the line, drawn over out. Each pixel goes to the first
+ * one there. A sprite behind the background still takes the pixel it loses
+ * to it.
+ */
+static void ppu_sprites(struct gb *gb, const uint8_t *line, uint8_t *out, const uint8_t **found, unsigned count) {
+	uint8_t taken[SCREEN_WIDTH + 16] = { 0 };
+	for(unsigned i = 0; i < count; ++i) {
+		const uint8_t *s = found[i];
+		uint8_t palette = s[3] & OBJ_PALETTE ? gb->obp1 : gb->obp0;
+		uint8_t px[8];
+		memcpy(px, &gb->tile_rows[ppu_sprite_row(gb, s)], 8);
+		/* X is the screen position plus 8 */
+		for(unsigned j = 0; j < 8; ++j) {
+			unsigned x = s[1] + (s[3] & OBJ_FLIP_X ? 7 - j : j);
+			if(!px[j] || x < 8 || x >= SCREEN_WIDTH + 8 || taken[x]) {
+				continue;
+			}
+			taken[x] = 1;
+			if(!(s[3] & OBJ_BEHIND) || !line[x - 8]) {
+				out[x - 8] = palette >> (px[j] * 2) & 3;
+			}
+		}
+	}
+}
+
+/* The line drawn with key last time comes out the same now. */
+static int ppu_clean(struct gb *gb, const struct line_key *key, const struct line_key *last, const uint8_t **found) {
+	if(!last->drawn || memcmp(key, last, offsetof(struct line_key, drawn))) {
+		return 0;
+	}
+	if(gb->vram_stamp == last->stamp) {
+		return 1;
+	}
+	if(key->lcdc & LCDC_BG) {
+		if(!ppu_tiles_clean(gb, key->lcdc & LCDC_BG_MAP ? 0x1C00 : 0x1800,
+			key->scx, key->bg_y, SCREEN_WIDTH / 8 + 1, last->stamp)) {
+			return 0;
+		}
+		if(key->window && !ppu_tiles_clean(gb, key->lcdc & LCDC_WINDOW_MAP ? 0x1C00 : 0x1800,
+			0, key->window - 1, SCREEN_WIDTH / 8 + 1, last->stamp)) {
+			return 0;
+		}
+	}
+	for(unsigned i = 0; i < key->nsprites; ++i) {
+		if(gb->tile_stamp[ppu_sprite_row(gb, found[i])] > last->stamp) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Draws line LY into the framebuffer. Everything it is drawn from goes into
+ * a key, the registers and the sprites on it by value, the tile maps and
+ * tiles by when they last changed. If that is all the same as when the line
+ * was last drawn the framebuffer already holds it.
+ */
+static void ppu_render(struct gb *gb) {
+	uint8_t line[SCREEN_WIDTH];
+	uint8_t *out = gb->framebuffer + gb->ly * SCREEN_WIDTH;
+	struct line_key *last = &gb->lines[gb->ly];
+	struct line_key key;
+	const uint8_t *found[OBJ_PER_LINE];
+	uint8_t shade[4];
+	
+	memset(&key, 0, sizeof(key));
+	key.lcdc = gb->lcdc;
+	key.scx = gb->scx;
+	key.bg_y = gb->scy + gb->ly;
+	key.wx = gb->wx;
+	key.bgp = gb->bgp;
+	key.obp0 = gb->obp0;
+	key.obp1 = gb->obp1;
+	if((gb->lcdc & LCDC_BG) && (gb->lcdc & LCDC_WINDOW) && gb->wy <= gb->ly && gb->wx < SCREEN_WIDTH + 7) {
+		key.window = ++gb->window_line;
+	}
+	if(gb->lcdc & LCDC_OBJ) {
+		key.nsprites = ppu_oam_search(gb, found);
+		for(unsigned i = 0; i < key.nsprites; ++i) {
+			memcpy(&key.sprites[i], found[i], 4);
+		}
+	}
+	if(ppu_clean(gb, &key, last, found)) {
+		++gb->lines_reused;
+		return;
+	}
+	
+	ppu_background(gb, line, key.window);
+	for(unsigned i = 0; i < 4; ++i) {
+		shade[i] = gb->lcdc & LCDC_BG ? gb->bgp >> (i * 2) & 3 : 0;
+	}
+	for(unsigned x = 0; x < SCREEN_WIDTH; ++x) {
+		out[x] = shade[line[x]];
+	}
+	if(gb->lcdc & LCDC_OBJ) {
+		ppu_sprites(gb, line, out, found, key.nsprites);
+	}
+	key.drawn = 1;
+	key.stamp = gb->vram_stamp;
+	memcpy(last, &key, sizeof(key));
+}
+
+/* The mode that is on now ends, ppu_next is when. */
+static void ppu_step(struct gb *gb) {
+	uint64_t when = gb->ppu_next;
+	switch(gb->stat & 3) {
+		case MODE_OAM:
+			ppu_mode(gb, MODE_DRAW);
+			gb->ppu_next = when + DRAW_CYCLES;
+			break;
+		case MODE_DRAW:
+			if(gb->framebuffer && (!gb->render_skip || gb->render_now)) {
+				ppu_render(gb);
+			}
+			ppu_mode(gb, MODE_HBLANK);
+			gb->ppu_next = when + HBLANK_CYCLES;
+			break;
+		case MODE_HBLANK:
+			ppu_line(gb, gb->ly + 1);
+			if(gb->ly == SCREEN_LINES) {
+				cpu_request(gb, INT_VBLANK);
+				gb->lines_skipped = gb->lines_reused;
+				ppu_mode(gb, MODE_VBLANK);
+				gb->ppu_next = when + LINE_CYCLES;
+				gb->ppu_vblank = when + FRAME_CYCLES;
+			} else {
+				ppu_mode(gb, MODE_OAM);
+				gb->ppu_next = when + OAM_CYCLES;
+			}
+			break;
+		case MODE_VBLANK:
+			if(gb->ly == LAST_LINE) {
+				ppu_line(gb, 0);
+				ppu_mode(gb, MODE_OAM);
+				gb->ppu_next = when + OAM_CYCLES;
+			} else {
+				ppu_line(gb, gb->ly + 1);
+				gb->ppu_next = when + LINE_CYCLES;
+			}
+			break;
+	}
+}
+
+/* Runs the PPU up to the cycle now. */
+static inline void ppu_catch_up(struct gb *gb, uint64_t now) {
+	while(gb->ppu_next <= now) {
+		ppu_step(gb);
+	}
+}
+
+/* The deadline for the next interrupt that could be taken. */
+static void ppu_schedule(struct gb *gb) {
+	if(!(gb->lcdc & LCDC_ON)) {
+		sched_cancel(gb, EVENT_PPU);
+	} else if((gb->ie & INT_STAT) && (gb->stat & STAT_INTS)) {
+		sched_add(gb, EVENT_PPU, gb->ppu_next);
+	} else {
+		sched_add(gb, EVENT_PPU, gb->ppu_vblank);
+	}
+}
+
+void ppu_event(struct gb *gb, uint64_t when) {
+	ppu_catch_up(gb, when);
+	ppu_schedule(gb);
+}
+
+/* Brings the PPU up to date before the CPU looks at it or changes it. */
+void video_sync(struct gb *gb) {
+	ppu_catch_up(gb, gb->cycle_counter);
+}
+
+/* IE changed, which decides what the PPU needs a deadline for. */
+void video_interrupts(struct gb *gb) {
+	video_sync(gb);
+	ppu_schedule(gb);
+}
+
+/* FF40-FF4B, except DMA */
+uint8_t video_read(struct gb *gb, uint16_t address) {
+	video_sync(gb);
+	switch(address) {
+		case 0xFF40: return gb->lcdc;
+		case 0xFF41: return gb->stat | 0x80;
+		case 0xFF42: return gb->scy;
+		case 0xFF43: return gb->scx;
+		case 0xFF44: return gb->ly;
+		case 0xFF45: return gb->lyc;
+		case 0xFF47: return gb->bgp;
+		case 0xFF48: return gb->obp0;
+		case 0xFF49: return gb->obp1;
+		case 0xFF4A: return gb->wy;
+		case 0xFF4B: return gb->wx;
+	}
+	return 0xFF;
+}
+
+void video_write(struct gb *gb, uint16_t address, uint8_t value) {
+	video_sync(gb);
+	switch(address) {
+		case 0xFF40:
+			if((value ^ gb->lcdc) & LCDC_ON) {
+				/* off stops the PPU on line 0 in hblank, on starts a frame */
+				gb->stat &= ~3;
+				ppu_line(gb, 0);
+				if(value & LCDC_ON) {
+					gb->stat |= MODE_OAM;
+					gb->ppu_next = gb->cycle_counter + OAM_CYCLES;
+					gb->ppu_vblank = gb->cycle_counter + SCREEN_LINES * LINE_CYCLES;
+				} else {
+					gb->ppu_next = UINT64_MAX;
+				}
+			}
+			gb->lcdc = value;
+			ppu_schedule(gb);
+			break;
+		case 0xFF41:
+			gb->stat = (gb->stat & ~STAT_WRITABLE) | (value & STAT_WRITABLE);
+			ppu_schedule(gb);
+			break;
+		case 0xFF42: gb->scy = value; break;
+		case 0xFF43: gb->scx = value; break;
+		case 0xFF45:
+			gb->lyc = value;
+			if(gb->lcdc & LCDC_ON) {
+				ppu_lyc(gb);
+			}
+			break;
+		case 0xFF47: gb->bgp = value; break;
+		case 0xFF48: gb->obp0 = value; break;
+		case 0xFF49: gb->obp1 = value; break;
+		case 0xFF4A: gb->wy = value; break;
+		case 0xFF4B: gb->wx = value; break;
+	}
+}
+
+uint8_t vram_read(struct gb *gb, uint16_t address) {
+	return gb->vram[address - 0x8000];
+}
+
+void vram_write(struct gb *gb, uint16_t address, uint8_t value) {
+	unsigned offset = address - 0x8000;
+	if(gb->vram[offset] == value) {
+		return;
+	}
+	video_sync(gb);
+	gb->vram[offset] = value;
+	++gb->vram_stamp;
+	if(offset < TILES * 16) {
+		const uint8_t *row = &gb->vram[offset & ~1];
+		gb->tile_rows[offset >> 1] = tile_bits[row[0]] | tile_bits[row[1]] << 1;
+		gb->tile_stamp[offset >> 1] = gb->vram_stamp;
+	} else {
+		gb->map_stamp[(offset - TILES * 16) / 32] = gb->vram_stamp;
+	}
+}
+
+/* Everything the CPU can see, registers, counters, memory and every IO
+ * register read back through the bus. */
+static int verify_same(struct gb *a, struct gb *b) {
+	if(memcmp(&a->r, &b->r, sizeof(struct registers))
+		|| a->cycle_counter != b->cycle_counter
+		|| a->instr_counter != b->instr_counter
+		|| memcmp(a->wram, b->wram, 0x2000)
+		|| memcmp(a->hram, b->hram, 127)
+		|| memcmp(a->vram, b->vram, 0x2000)
+		|| memcmp(a->oam, b->oam, 160)) {
+		return 0;
+	}
+	for(unsigned address = 0xFF00; address <= 0xFFFF; address = address == 0xFF7F ? 0xFFFF : address + 1) {
+		if(read(a, address) != read(b, address)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Runs rom for the given number of frames twice side by side, drawing every
+ * frame on one and none on the other with render skip, and compares what the
+ * CPU can see after every frame. Returns 0 if it never differs.
+ */
+int video_verify_skip(const char *rom, uint64_t frames, FILE *out) {
+	static uint8_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+	static uint8_t skipped[SCREEN_WIDTH * SCREEN_HEIGHT];
+	struct gb *ref = gb_alloc();
+	struct gb *gb = gb_alloc();
+	uint64_t n = 0;
+	int ret = 0;
+	
+	if(cart_load(ref, rom) || cart_load(gb, rom)) {
+		fprintf(out, "%s: could not load rom\n", rom);
+		ret = -1;
+	} else {
+		video_framebuffer(ref, framebuffer);
+		video_framebuffer(gb, skipped);
+		video_render_skip(gb, 1);
+		cpu_bios_init(ref);
+		cpu_bios_init(gb);
+		for(; n < frames && !gb->stop_reason; ++n) {
+			run_frame(ref);
+			run_frame(gb);
+			if(!verify_same(ref, gb)) {
+				fprintf(out, "render skip: mismatch in frame %llu, PC=%04X and PC=%04X\n",
+					(unsigned long long)n, ref->r.PC, gb->r.PC);
+				ret = 1;
+				break;
+			}
+		}
+		if(!ret) {
+			fprintf(out, "render skip: %llu frames, %llu instructions, no mismatch\n",
+				(unsigned long long)n, (unsigned long long)gb->instr_counter);
+		}
+	}
+	gb_free(ref);
+	gb_free(gb);
+	return ret;
 }